@@ -3,24 +3,66 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "Common.h"
+#include "ConvertCache.h"
 #include "Exe.h"
+#include "Log.h"
 
 // program entry point
 int main(int argc, char* argv[]) {
   char szErrorMessage[ERROR_LEN + 1] = {0};
   char szExeFilename[OPTION_LEN + 1] = {0};
   char szDxtFilename[OPTION_LEN + 1] = {0};
+  char szCacheDir[OPTION_LEN + 1] = {0};
+  char szCacheSize[OPTION_LEN + 1] = {0};
+  char szCacheLink[OPTION_LEN + 1] = "no";
+  uint64_t qwCacheLimit;
+  bool bCacheLink;
+  std::unique_ptr<ConvertCache> Cache;
+  std::vector<uint08> ExeImage;
+  int DxtStream = -1;
 
   const char* program = argv[0];
   const char* program_desc = "CDXT: EXE to DXT Relinker";
-  static Option options[] = {{szExeFilename, NULL, "exefile"}, {szDxtFilename, "OUT", "filename"}, {NULL}};
+  static Option options[] = {{szExeFilename, NULL, "exefile"},
+                             {szDxtFilename, "OUT", "filename"},
+                             {szCacheDir, "CACHE", "directory"},
+                             {szCacheSize, "CACHESIZE", "megabytes"},
+                             {szCacheLink, "CACHELINK", "{no|yes}"},
+                             {NULL}};
 
   if (ParseOptions(argv, argc, options, szErrorMessage)) {
     goto cleanup;
   }
 
+  // "-" as output (the default for "-" as input) sends the Dxt to standard output, and progress to standard error
+  if (IsStdStream(szDxtFilename) || (szDxtFilename[0] == '\0' && IsStdStream(szExeFilename))) {
+    strncpy(szDxtFilename, "-", OPTION_LEN);
+
+    DxtStream = RedirectStdout();
+
+    if (DxtStream < 0) {
+      strncpy(szErrorMessage, "Unable to redirect standard output", ERROR_LEN);
+      goto cleanup;
+    }
+  }
+
+  if (!ConvertCache::ParseLimit(szCacheSize, qwCacheLimit)) {
+    strncpy(szErrorMessage, "invalid CACHESIZE", ERROR_LEN);
+    goto cleanup;
+  }
+
+  if (CompareString(szCacheLink, "NO"))
+    bCacheLink = false;
+  else if (CompareString(szCacheLink, "YES"))
+    bCacheLink = true;
+  else {
+    strncpy(szErrorMessage, "invalid CACHELINK", ERROR_LEN);
+    goto cleanup;
+  }
+
   // verify we recieved the required parameters
   if (szExeFilename[0] == '\0') {
     ShowUsage(program, program_desc, options);
@@ -32,9 +74,35 @@ int main(int argc, char* argv[]) {
     GenerateFilename(szDxtFilename, ".dxt", szExeFilename, ".exe");
   }
 
+  // an Exe converted before is taken straight from the cache, without even being parsed
+  if (szCacheDir[0] != 0) {
+    if (DxtStream >= 0 || IsStdStream(szExeFilename)) {
+      LogPrintf(LL_INFO, "CACHE -> Warning: Only used between files\n");
+    } else {
+      Cache.reset(new ConvertCache(szCacheDir, "cdxt", qwCacheLimit, bCacheLink));
+
+      if (Cache->AddFile(szExeFilename) && Cache->Fetch(szDxtFilename)) goto cleanup;
+
+      if (Cache->GetError() != 0) {
+        LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
+        Cache.reset();
+      }
+    }
+  }
+
   // open and convert Exe file
   {
-    Exe* ExeFile = new Exe(szExeFilename);
+    Exe* ExeFile;
+
+    if (IsStdStream(szExeFilename)) {
+      if (!ReadStream(STDIN_FILENO, ExeImage)) {
+        strncpy(szErrorMessage, "Unable to read Exe from standard input", ERROR_LEN);
+        goto cleanup;
+      }
+
+      ExeFile = new Exe(ExeImage.data(), (uint32)ExeImage.size());
+    } else
+      ExeFile = new Exe(szExeFilename);
 
     if (ExeFile->GetError() != 0) {
       strncpy(szErrorMessage, ExeFile->GetError(), ERROR_LEN);
@@ -76,16 +144,21 @@ int main(int argc, char* argv[]) {
     // If our DXT do not respect this, the DXT loader will crash during
     // relocation (using .reloc) when trying to access sections.
     for (uint32 v = 0; v < ExeFile->m_Header.m_sections; v++) {
-      fprintf(stderr, "%8s\n", ExeFile->m_SectionHeader[v].m_name);
+      LogPrintf(LL_VERBOSE, "Cdxt: Placing Section %8.8s at its virtual address\n", ExeFile->m_SectionHeader[v].m_name);
       ExeFile->m_SectionHeader[v].m_raw_addr = ExeFile->m_SectionHeader[v].m_virtual_addr;
     }
 
-    ExeFile->Export(szDxtFilename);
+    if (DxtStream >= 0)
+      ExeFile->ExportStream(DxtStream);
+    else
+      ExeFile->Export(szDxtFilename);
 
     if (ExeFile->GetError() != 0) {
       strncpy(szErrorMessage, ExeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
+
+    if (Cache && !Cache->Store(szDxtFilename)) LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
   }
 
 cleanup:
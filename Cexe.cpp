@@ -21,9 +21,12 @@
 // *
 // ******************************************************************
 #include <string.h>
+#include <unistd.h>
 
 #include "Common.h"
+#include "ConvertCache.h"
 #include "Exe.h"
+#include "Log.h"
 #include "Xbe.h"
 
 static bool ConvertXbe(Xbe *xbe, Exe *exe);
@@ -36,7 +39,15 @@ int main(int argc, char *argv[]) {
   char szDumpFilename[OPTION_LEN + 1] = {0};
   char szXbeTitle[OPTION_LEN + 1] = "Untitled";
   char szMode[OPTION_LEN + 1] = "retail";
+  char szCacheDir[OPTION_LEN + 1] = {0};
+  char szCacheSize[OPTION_LEN + 1] = {0};
+  char szCacheLink[OPTION_LEN + 1] = "no";
   bool bRetail;
+  uint64_t qwCacheLimit;
+  bool bCacheLink;
+  std::unique_ptr<ConvertCache> Cache;
+  std::vector<uint08> XbeImage;
+  int ExeStream = -1;
 
   const char *program = argv[0];
   const char *program_desc = "CEXE XBE to EXE (Xbox to win32) Relinker (Version: " VERSION ")";
@@ -44,12 +55,27 @@ int main(int argc, char *argv[]) {
                       {szExeFilename, "OUT", "filename"},
                       {szDumpFilename, "DUMPINFO", "filename"},
                       {szMode, "MODE", "{debug|retail}"},
+                      {szCacheDir, "CACHE", "directory"},
+                      {szCacheSize, "CACHESIZE", "megabytes"},
+                      {szCacheLink, "CACHELINK", "{no|yes}"},
                       {NULL}};
 
   if (ParseOptions(argv, argc, options, szErrorMessage)) {
     goto cleanup;
   }
 
+  // "-" as output (the default for "-" as input) sends the Exe to standard output, and progress to standard error
+  if (IsStdStream(szExeFilename) || (szExeFilename[0] == '\0' && IsStdStream(szXbeFilename))) {
+    strncpy(szExeFilename, "-", OPTION_LEN);
+
+    ExeStream = RedirectStdout();
+
+    if (ExeStream < 0) {
+      strncpy(szErrorMessage, "Unable to redirect standard output", ERROR_LEN);
+      goto cleanup;
+    }
+  }
+
   if (CompareString(szMode, "RETAIL"))
     bRetail = true;
   else if (CompareString(szMode, "DEBUG"))
@@ -59,6 +85,20 @@ int main(int argc, char *argv[]) {
     goto cleanup;
   }
 
+  if (!ConvertCache::ParseLimit(szCacheSize, qwCacheLimit)) {
+    strncpy(szErrorMessage, "invalid CACHESIZE", ERROR_LEN);
+    goto cleanup;
+  }
+
+  if (CompareString(szCacheLink, "NO"))
+    bCacheLink = false;
+  else if (CompareString(szCacheLink, "YES"))
+    bCacheLink = true;
+  else {
+    strncpy(szErrorMessage, "invalid CACHELINK", ERROR_LEN);
+    goto cleanup;
+  }
+
   // verify we received the required parameters
   if (szXbeFilename[0] == '\0') {
     ShowUsage(program, program_desc, options);
@@ -73,9 +113,37 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // an Xbe converted the same way before is taken straight from the cache, without even being parsed
+  if (szCacheDir[0] != 0) {
+    if (ExeStream >= 0 || IsStdStream(szXbeFilename) || szDumpFilename[0] != 0) {
+      LogPrintf(LL_INFO, "CACHE -> Warning: Only used between files, and without DUMPINFO\n");
+    } else {
+      Cache.reset(new ConvertCache(szCacheDir, "cexe", qwCacheLimit, bCacheLink));
+
+      Cache->AddOption("MODE", bRetail ? "retail" : "debug");
+
+      if (Cache->AddFile(szXbeFilename) && Cache->Fetch(szExeFilename)) goto cleanup;
+
+      if (Cache->GetError() != 0) {
+        LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
+        Cache.reset();
+      }
+    }
+  }
+
   // open and convert Exe file
   {
-    Xbe *XbeFile = new Xbe(szXbeFilename);
+    Xbe *XbeFile;
+
+    if (IsStdStream(szXbeFilename)) {
+      if (!ReadStream(STDIN_FILENO, XbeImage)) {
+        strncpy(szErrorMessage, "Unable to read Xbe from standard input", ERROR_LEN);
+        goto cleanup;
+      }
+
+      XbeFile = new Xbe(XbeImage.data(), (uint32)XbeImage.size());
+    } else
+      XbeFile = new Xbe(szXbeFilename);
     if (XbeFile->GetError() != 0) {
       strncpy(szErrorMessage, XbeFile->GetError(), ERROR_LEN);
       goto cleanup;
@@ -88,6 +156,7 @@ int main(int argc, char *argv[]) {
     }
 
     if (!ConvertXbe(XbeFile, ExeFile)) {
+      if (XbeFile->GetError() != 0) strncpy(szErrorMessage, XbeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
 
@@ -107,11 +176,16 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    ExeFile->Export(szExeFilename);
+    if (ExeStream >= 0)
+      ExeFile->ExportStream(ExeStream);
+    else
+      ExeFile->Export(szExeFilename);
     if (ExeFile->GetError() != 0) {
       strncpy(szErrorMessage, ExeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
+
+    if (Cache && !Cache->Store(szExeFilename)) LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
   }
 
 cleanup:
@@ -187,17 +261,21 @@ static bool ConvertXbe(Xbe *xbe, Exe *exe) {
   // IMAGE_FILE_32BIT_MACHINE
   header.m_characteristics = 0x103;
 
-  exe->m_SectionHeader = new Exe::SectionHeader[xbe->m_Header.dwSections];
-  exe->m_bzSection = new uint08 *[xbe->m_Header.dwSections];
+  exe->m_SectionHeader = new Exe::SectionHeader[xbe->m_Header.dwSections]();
+  exe->m_bzSection = new uint08 *[xbe->m_Header.dwSections]();
+  exe->m_dwSectionSize = new uint32[xbe->m_Header.dwSections]();
 
   auto raw_offset = optional_header.m_sizeof_headers;
   for (auto i = 0; i < xbe->m_Header.dwSections; ++i) {
-    auto section = xbe->m_bzSection[i];
+    auto section = xbe->GetSection(i);
     auto &section_header = xbe->m_SectionHeader[i];
 
+    if (section == nullptr) return false;
+
+    // the Xbe outlives the Exe, so its sections are written out from where they are (padding reads as zeros),
+    // straight from the Xbe file if it is mapped
     auto section_size = section_header.dwSizeofRaw;
-    exe->m_bzSection[i] = new uint08[section_size];
-    memcpy(exe->m_bzSection[i], section, section_size);
+    exe->SetSectionView(i, section, section_size, xbe->GetFile());
 
     exe->m_SectionHeader[i].m_virtual_size = section_header.dwVirtualSize;
     exe->m_SectionHeader[i].m_virtual_addr = section_header.dwVirtualAddr - optional_header.m_image_base;
@@ -224,5 +302,7 @@ static bool ConvertXbe(Xbe *xbe, Exe *exe) {
     }
   }
 
+  exe->IndexSections();
+
   return true;
 }
@@ -5,10 +5,17 @@
 #include "Common.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "Cxbx.h"
+#include "Log.h"
 
 // parse command line
 int ParseOptions(char *argv[], int argc, const Option *options, char *szErrorMessage) {
@@ -17,12 +24,23 @@ int ParseOptions(char *argv[], int argc, const Option *options, char *szErrorMes
     char *szOption = 0;
     char *szParam = 0;
 
-    // if this isn't an option, it must be the default option
-    if (argv[v][0] != '-') {
+    // if this isn't an option, it must be the default option (a lone "-" is standard input)
+    if (argv[v][0] != '-' || argv[v][1] == '\0') {
       strncpy(options[0].value, argv[v], OPTION_LEN);
       continue;
     }
 
+    // switches shared by every tool
+    if (CompareString(&argv[v][1], "QUIET")) {
+      SetLogLevel(LL_ERROR);
+      continue;
+    }
+
+    if (CompareString(&argv[v][1], "VERBOSE")) {
+      SetLogLevel(LL_VERBOSE);
+      continue;
+    }
+
     // locate the colon and seperate option / parameters
     {
       uint dwColon = (uint)-1;
@@ -85,6 +103,13 @@ void ShowUsage(const char *program, const char *desc, const Option *options) {
       option++;
     }
   }
+
+  printf(
+      "\n"
+      "Switches :\n"
+      "\n"
+      "  -QUIET    only report errors\n"
+      "  -VERBOSE  report every section\n");
 }
 
 int GenerateFilename(char *szNewPath, const char *szNewExtension, const char *szOldPath, const char *szOldExtension) {
@@ -123,4 +148,112 @@ bool CompareString(const char *szA, const char *szB) {
   while (*szA != '\0' && *szB != '\0')
     if (toupper(*szA++) != toupper(*szB++)) return false;
   return *szA == *szB;
-}
\ No newline at end of file
+}
+
+// "-" stands for standard input or standard output
+bool IsStdStream(const char *szPath) { return szPath[0] == '-' && szPath[1] == '\0'; }
+
+// can a file descriptor be read out of order (pipes and terminals cannot)?
+bool IsSeekable(int fd) { return lseek(fd, 0, SEEK_CUR) >= 0; }
+
+// read everything from a file descriptor (such as standard input)
+bool ReadStream(int fd, std::vector<uint08> &buffer) {
+  buffer.clear();
+
+  size_t size = 0;
+
+  while (true) {
+    if (buffer.size() - size < 0x10000) buffer.resize(size + 0x10000 > 2 * size ? size + 0x10000 : 2 * size);
+
+    ssize_t got = read(fd, &buffer[size], buffer.size() - size);
+
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    if (got == 0) break;
+
+    size += got;
+  }
+
+  buffer.resize(size);
+
+  return true;
+}
+
+// take over standard output for data, everything printed from then on goes to standard error
+int RedirectStdout() {
+  fflush(stdout);
+
+  int fd = dup(STDOUT_FILENO);
+
+  if (fd >= 0) dup2(STDERR_FILENO, STDOUT_FILENO);
+
+  return fd;
+}
+
+// open a new file to write x_szPath's replacement into
+int OpenReplacement(const char *x_szPath, std::string &x_szTemp) {
+  struct stat st;
+
+  x_szTemp.clear();
+
+  bool bExists = stat(x_szPath, &st) == 0;
+
+  // devices, pipes and the like are written to as they are (nothing maps those)
+  if (bExists && !S_ISREG(st.st_mode)) return open(x_szPath, O_WRONLY | O_TRUNC);
+
+  // the replacement goes next to the file a symbolic link points at, so that renaming keeps the link
+  std::string szPath = x_szPath;
+
+  if (bExists) {
+    char szReal[PATH_MAX];
+
+    if (realpath(x_szPath, szReal) != NULL) szPath = szReal;
+  }
+
+  for (int v = 0; v < 100; v++) {
+    char szSuffix[32];
+
+    snprintf(szSuffix, sizeof(szSuffix), ".%d.%d.tmp", (int)getpid(), v);
+
+    x_szTemp = szPath + szSuffix;
+
+    int fd = open(x_szTemp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    if (fd >= 0) {
+      // a file that is replaced keeps its permissions
+      if (bExists) fchmod(fd, st.st_mode & 07777);
+
+      return fd;
+    }
+
+    if (errno != EEXIST) break;
+  }
+
+  x_szTemp.clear();
+
+  return -1;
+}
+
+// close a file from OpenReplacement and put it in place of x_szPath
+bool FinishReplacement(int x_fd, const std::string &x_szTemp, const char *x_szPath, bool x_bKeep) {
+  if (close(x_fd) != 0) x_bKeep = false;
+
+  // opened directly, there is nothing to rename
+  if (x_szTemp.empty()) return x_bKeep;
+
+  if (x_bKeep) {
+    // a symbolic link is kept, and its target replaced
+    char szReal[PATH_MAX];
+
+    const char *szPath = realpath(x_szPath, szReal) != NULL ? szReal : x_szPath;
+
+    if (rename(x_szTemp.c_str(), szPath) == 0) return true;
+  }
+
+  unlink(x_szTemp.c_str());
+
+  return false;
+}
@@ -5,6 +5,11 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <string>
+#include <vector>
+
+#include "Cxbx.h"
+
 #define OPTION_LEN 266
 #define ERROR_LEN 256
 
@@ -19,4 +24,25 @@ void ShowUsage(const char *program, const char *desc, const Option *options);
 int GenerateFilename(char *szNewPath, const char *szNewExtension, const char *szOldPath, const char *szOldExtension);
 bool CompareString(const char *szA, const char *szB);
 
+// "-" stands for standard input or standard output
+bool IsStdStream(const char *szPath);
+
+// can a file descriptor be read out of order (pipes and terminals cannot)?
+bool IsSeekable(int fd);
+
+// read everything from a file descriptor (such as standard input)
+bool ReadStream(int fd, std::vector<uint08> &buffer);
+
+// take over standard output for data, everything printed from then on goes to standard error
+int RedirectStdout();
+
+// open a new file to write x_szPath's replacement into, so that nothing is written to a file that may still be
+// read from (an input mapped by the converter, for one); x_szTemp receives its name, which is empty if x_szPath
+// is not a regular file and was opened directly instead, returns -1 on error
+int OpenReplacement(const char *x_szPath, std::string &x_szTemp);
+
+// close a file from OpenReplacement and, if x_bKeep, rename it over x_szPath (otherwise it is removed, leaving
+// x_szPath as it was), returns false if it could not be put in place
+bool FinishReplacement(int x_fd, const std::string &x_szTemp, const char *x_szPath, bool x_bKeep);
+
 #endif
\ No newline at end of file
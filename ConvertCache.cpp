@@ -0,0 +1,423 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "ConvertCache.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "Common.h"
+#include "Log.h"
+#include "MappedFile.h"
+
+// first line of an index, followed by one line per output
+#define CONVERTCACHE_INDEX_HEADER "convertcache 1 hits %llu misses %llu evictions %llu tick %llu\n"
+#define CONVERTCACHE_INDEX_ENTRY "%s %llu %lld %lld %llu\n"
+
+// modification time of a file, to the nanosecond where the platform keeps it
+static void GetModified(const struct stat &x_st, int64_t &x_qwTime, int64_t &x_qwTimeNs) {
+#if defined(__APPLE__)
+  x_qwTime = x_st.st_mtimespec.tv_sec;
+  x_qwTimeNs = x_st.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L
+  x_qwTime = x_st.st_mtim.tv_sec;
+  x_qwTimeNs = x_st.st_mtim.tv_nsec;
+#else
+  x_qwTime = x_st.st_mtime;
+  x_qwTimeNs = 0;
+#endif
+}
+
+// copy everything from x_fdIn into a new file x_szTo
+static bool CopyFile(int x_fdIn, const char *x_szTo) {
+  int fdOut = open(x_szTo, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+  if (fdOut < 0) return false;
+
+  uint08 Buffer[0x10000];
+  bool bDone = false;
+
+  while (true) {
+    ssize_t got = read(x_fdIn, Buffer, sizeof(Buffer));
+
+    if (got < 0 && errno == EINTR) continue;
+
+    if (got <= 0) {
+      bDone = got == 0;
+      break;
+    }
+
+    ssize_t put = 0;
+
+    while (put < got) {
+      ssize_t written = write(fdOut, &Buffer[put], got - put);
+
+      if (written < 0 && errno == EINTR) continue;
+
+      if (written <= 0) break;
+
+      put += written;
+    }
+
+    if (put < got) break;
+  }
+
+  if (close(fdOut) != 0) bDone = false;
+
+  if (!bDone) unlink(x_szTo);
+
+  return bDone;
+}
+
+// make x_szTo hold what x_szFrom does: sharing its blocks if the filesystem can, else as a link to it if
+// x_bLink allows, and else as a plain copy (x_szTo is only replaced once that worked, and only if it is a
+// regular file)
+static bool PlaceFile(const char *x_szFrom, const char *x_szTo, bool x_bLink) {
+  struct stat st;
+
+  if (stat(x_szTo, &st) == 0 && !S_ISREG(st.st_mode)) return false;
+
+  char szSuffix[32];
+
+  snprintf(szSuffix, sizeof(szSuffix), ".%d.tmp", (int)getpid());
+
+  std::string szTemp = std::string(x_szTo) + szSuffix;
+
+  unlink(szTemp.c_str());
+
+  int fdIn = open(x_szFrom, O_RDONLY);
+
+  if (fdIn < 0) return false;
+
+  bool bPlaced = false;
+
+#ifdef FICLONE
+  {
+    int fdOut = open(szTemp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    if (fdOut >= 0) {
+      bPlaced = ioctl(fdOut, FICLONE, fdIn) == 0;
+
+      close(fdOut);
+
+      if (!bPlaced) unlink(szTemp.c_str());
+    }
+  }
+#endif
+
+  if (!bPlaced && x_bLink) bPlaced = link(x_szFrom, szTemp.c_str()) == 0;
+
+  if (!bPlaced) bPlaced = CopyFile(fdIn, szTemp.c_str());
+
+  close(fdIn);
+
+  if (bPlaced && rename(szTemp.c_str(), x_szTo) != 0) {
+    unlink(szTemp.c_str());
+    bPlaced = false;
+  }
+
+  return bPlaced;
+}
+
+// outputs of x_szTool kept in directory x_szDir
+ConvertCache::ConvertCache(const char *x_szDir, const char *x_szTool, uint64_t x_qwLimit, bool x_bLink)
+    : m_szDir(x_szDir), m_qwLimit(x_qwLimit), m_bLink(x_bLink) {
+  // a new version of the tool may well convert differently
+  AddOption(x_szTool, VERSION);
+}
+
+// bytes a cache may keep, from a number of megabytes
+bool ConvertCache::ParseLimit(const char *x_szMB, uint64_t &x_qwLimit) {
+  uint64_t qwMB = CONVERTCACHE_DEFAULT_MB;
+
+  if (x_szMB[0] != 0) {
+    char *szEnd;
+
+    errno = 0;
+    qwMB = strtoull(x_szMB, &szEnd, 10);
+
+    if (*szEnd != 0 || errno != 0 || !isdigit((unsigned char)x_szMB[0]) || qwMB > (UINT64_MAX >> 20)) return false;
+  }
+
+  x_qwLimit = qwMB << 20;
+
+  return true;
+}
+
+// an option that affects the output
+void ConvertCache::AddOption(const char *x_szKey, const char *x_szValue) {
+  m_Key.Update(x_szKey, strlen(x_szKey) + 1);
+  m_Key.Update(x_szValue, strlen(x_szValue) + 1);
+}
+
+// a file whose contents affect the output
+bool ConvertCache::AddFile(const char *x_szFilename) {
+  MappedFile File;
+  std::vector<uint08> Buffer;
+  const uint08 *pData = 0;
+  uint64_t qwSize = 0;
+
+  if (File.Open(x_szFilename)) {
+    pData = File.GetData();
+    qwSize = File.GetSize();
+  } else {
+    // empty, or not a regular file
+    int fd = open(x_szFilename, O_RDONLY);
+
+    bool bRead = fd >= 0 && ReadStream(fd, Buffer);
+
+    if (fd >= 0) close(fd);
+
+    if (!bRead) {
+      SetError("Could not read a file the conversion depends on", false);
+      return false;
+    }
+
+    pData = Buffer.data();
+    qwSize = Buffer.size();
+  }
+
+  // the length keeps one file's contents from running into whatever is added next
+  m_Key.Update(&qwSize, sizeof(qwSize));
+  m_Key.Update(pData, qwSize);
+
+  return true;
+}
+
+// put the cached output for this key at x_szFilename
+bool ConvertCache::Fetch(const char *x_szFilename) {
+  const std::string &szKey = GetKey();
+
+  bool bHit = false;
+
+  if (!Lock()) return false;
+
+  for (auto Entry = m_Entries.begin(); Entry != m_Entries.end(); ++Entry) {
+    if (Entry->szKey != szKey) continue;
+
+    std::string szPath = EntryPath(szKey);
+
+    struct stat st;
+    int64_t qwTime, qwTimeNs;
+
+    // an output that has been written to since it was stored (through a link, if links are used) is of no use
+    // any more
+    bool bCurrent = false;
+
+    if (stat(szPath.c_str(), &st) == 0 && (uint64_t)st.st_size == Entry->qwSize) {
+      GetModified(st, qwTime, qwTimeNs);
+
+      bCurrent = qwTime == Entry->qwTime && qwTimeNs == Entry->qwTimeNs;
+    }
+
+    if (!bCurrent) {
+      LogPrintf(LL_VERBOSE, "ConvertCache: Dropping %s, it has changed since it was stored\n", szKey.c_str());
+
+      unlink(szPath.c_str());
+      m_Entries.erase(Entry);
+      break;
+    }
+
+    // an output that cannot be put in place is a miss, but the cached one is still good
+    bHit = PlaceFile(szPath.c_str(), x_szFilename, m_bLink);
+
+    if (bHit) Entry->qwUsed = ++m_qwTick;
+
+    break;
+  }
+
+  // (exporting replaces the output by renaming a new file over it, so even an output that is still a link
+  // into the cache is not written through on a miss)
+  if (bHit)
+    m_qwHits++;
+  else
+    m_qwMisses++;
+
+  Unlock();
+
+  LogStats(bHit ? "Hit" : "Miss");
+
+  return bHit;
+}
+
+// keep the freshly converted x_szFilename for this key
+bool ConvertCache::Store(const char *x_szFilename) {
+  const std::string &szKey = GetKey();
+
+  if (!Lock()) return false;
+
+  std::string szPath = EntryPath(szKey);
+
+  struct stat st;
+
+  // never linked, so that the output can be changed without changing the cache
+  if (!PlaceFile(x_szFilename, szPath.c_str(), false) || stat(szPath.c_str(), &st) != 0) {
+    Unlock();
+
+    SetError("Could not store the output in the cache", false);
+    return false;
+  }
+
+  m_Entries.erase(std::remove_if(m_Entries.begin(), m_Entries.end(),
+                                 [&](const Entry &x_Entry) { return x_Entry.szKey == szKey; }),
+                  m_Entries.end());
+
+  int64_t qwTime, qwTimeNs;
+
+  GetModified(st, qwTime, qwTimeNs);
+
+  m_Entries.push_back({szKey, (uint64_t)st.st_size, qwTime, qwTimeNs, ++m_qwTick});
+
+  // drop the least recently used outputs (other than this one) until the rest fit
+  {
+    std::sort(m_Entries.begin(), m_Entries.end(),
+              [](const Entry &x_A, const Entry &x_B) { return x_A.qwUsed > x_B.qwUsed; });
+
+    uint64_t qwTotal = 0;
+
+    for (auto &Entry : m_Entries) qwTotal += Entry.qwSize;
+
+    while (qwTotal > m_qwLimit && m_Entries.size() > 1) {
+      const Entry &Oldest = m_Entries.back();
+
+      LogPrintf(LL_VERBOSE, "ConvertCache: Evicting %s (%llu bytes)\n", Oldest.szKey.c_str(),
+                (unsigned long long)Oldest.qwSize);
+
+      unlink(EntryPath(Oldest.szKey).c_str());
+
+      qwTotal -= Oldest.qwSize;
+      m_qwEvictions++;
+      m_Entries.pop_back();
+    }
+  }
+
+  Unlock();
+
+  LogStats("Stored");
+
+  return true;
+}
+
+// take the directory lock and read the index
+bool ConvertCache::Lock() {
+  std::string szObjects = m_szDir + "/objects";
+
+  if ((mkdir(m_szDir.c_str(), 0777) != 0 && errno != EEXIST) ||
+      (mkdir(szObjects.c_str(), 0777) != 0 && errno != EEXIST)) {
+    SetError("Could not create the cache directory", false);
+    return false;
+  }
+
+  m_fdLock = open((m_szDir + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+
+  if (m_fdLock < 0) {
+    SetError("Could not open the cache lock", false);
+    return false;
+  }
+
+  while (flock(m_fdLock, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      close(m_fdLock);
+      m_fdLock = -1;
+
+      SetError("Could not lock the cache", false);
+      return false;
+    }
+  }
+
+  m_Entries.clear();
+  m_qwTick = m_qwHits = m_qwMisses = m_qwEvictions = 0;
+
+  // a missing or unreadable index is an empty cache
+  FILE *IndexFile = fopen((m_szDir + "/index").c_str(), "rt");
+
+  if (IndexFile != NULL) {
+    unsigned long long Hits, Misses, Evictions, Tick;
+
+    if (fscanf(IndexFile, CONVERTCACHE_INDEX_HEADER, &Hits, &Misses, &Evictions, &Tick) == 4) {
+      m_qwHits = Hits;
+      m_qwMisses = Misses;
+      m_qwEvictions = Evictions;
+      m_qwTick = Tick;
+
+      char szKey[SHA1_DIGEST_SIZE * 2 + 1];
+      unsigned long long Size, Used;
+      long long Time, TimeNs;
+
+      while (fscanf(IndexFile, "%40s %llu %lld %lld %llu", szKey, &Size, &Time, &TimeNs, &Used) == 5)
+        m_Entries.push_back({szKey, Size, Time, TimeNs, Used});
+    }
+
+    fclose(IndexFile);
+  }
+
+  return true;
+}
+
+// write the index back and drop the lock
+void ConvertCache::Unlock() {
+  std::string szIndex = m_szDir + "/index";
+  std::string szTemp = szIndex + ".tmp";
+
+  FILE *IndexFile = fopen(szTemp.c_str(), "wt");
+
+  if (IndexFile != NULL) {
+    fprintf(IndexFile, CONVERTCACHE_INDEX_HEADER, (unsigned long long)m_qwHits, (unsigned long long)m_qwMisses,
+            (unsigned long long)m_qwEvictions, (unsigned long long)m_qwTick);
+
+    for (auto &Entry : m_Entries)
+      fprintf(IndexFile, CONVERTCACHE_INDEX_ENTRY, Entry.szKey.c_str(), (unsigned long long)Entry.qwSize,
+              (long long)Entry.qwTime, (long long)Entry.qwTimeNs, (unsigned long long)Entry.qwUsed);
+
+    // swapped in whole, so that a failed write leaves the previous index in place
+    if (fclose(IndexFile) != 0 || rename(szTemp.c_str(), szIndex.c_str()) != 0) unlink(szTemp.c_str());
+  }
+
+  close(m_fdLock);
+  m_fdLock = -1;
+}
+
+// path of an output in the cache
+std::string ConvertCache::EntryPath(const std::string &x_szKey) const { return m_szDir + "/objects/" + x_szKey; }
+
+// finish the key off
+const std::string &ConvertCache::GetKey() {
+  if (m_szKey.empty()) {
+    uint08 Digest[SHA1_DIGEST_SIZE];
+
+    m_Key.Final(Digest);
+
+    char szHex[SHA1_DIGEST_SIZE * 2 + 1];
+
+    for (int v = 0; v < SHA1_DIGEST_SIZE; v++) sprintf(&szHex[v * 2], "%.02x", Digest[v]);
+
+    m_szKey = szHex;
+  }
+
+  return m_szKey;
+}
+
+// log how the cache has fared so far
+void ConvertCache::LogStats(const char *x_szOutcome) {
+  uint64_t qwTotal = 0;
+
+  for (auto &Entry : m_Entries) qwTotal += Entry.qwSize;
+
+  LogPrintf(LL_INFO, "ConvertCache: %s %s (%llu hits, %llu misses, %llu evicted, %.1f of %.1f MB in use)\n",
+            x_szOutcome, m_szKey.c_str(), (unsigned long long)m_qwHits, (unsigned long long)m_qwMisses,
+            (unsigned long long)m_qwEvictions, qwTotal / (1024.0 * 1024.0), m_qwLimit / (1024.0 * 1024.0));
+}
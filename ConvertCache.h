@@ -0,0 +1,94 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef CONVERTCACHE_H
+#define CONVERTCACHE_H
+
+#include <string>
+#include <vector>
+
+#include "Cxbx.h"
+#include "Error.h"
+#include "Sha1.h"
+
+// default bound on the bytes of output a cache directory keeps
+#define CONVERTCACHE_DEFAULT_MB 1024
+
+// on-disk cache of converted files, keyed by the contents of the input and every option that affects the
+// output; a hit puts a copy of the earlier output in place (sharing its blocks where the filesystem can, or
+// only if asked for, as a hard link) without parsing the input at all, and the least recently used outputs are
+// dropped once the cache grows too big
+//
+// errors are never fatal: a cache that cannot be used just means converting as usual
+class ConvertCache : public Error {
+ public:
+  // outputs of x_szTool kept in directory x_szDir (created if needed), at most x_qwLimit bytes of them; with
+  // x_bLink, hits that cannot share blocks are hard links into the cache rather than copies (so anything that
+  // then writes to such an output in place writes to the cache and every other output linked to it too)
+  ConvertCache(const char *x_szDir, const char *x_szTool, uint64_t x_qwLimit, bool x_bLink = false);
+
+  // bytes a cache may keep, from a number of megabytes (the default if x_szMB is empty), returns false if
+  // x_szMB is not a number
+  static bool ParseLimit(const char *x_szMB, uint64_t &x_qwLimit);
+
+  // an option that affects the output
+  void AddOption(const char *x_szKey, const char *x_szValue);
+
+  // a file whose contents affect the output (the input, or a file an option names)
+  bool AddFile(const char *x_szFilename);
+
+  // put the cached output for this key at x_szFilename, returns false on a miss (x_szFilename is left alone)
+  bool Fetch(const char *x_szFilename);
+
+  // keep a copy of the freshly converted x_szFilename for this key, dropping old outputs to stay within the
+  // limit
+  bool Store(const char *x_szFilename);
+
+ private:
+  // an output in the cache
+  struct Entry {
+    std::string szKey;
+    uint64_t qwSize;
+
+    // modification time the output had when it was stored, anything that writes to it through a link
+    // changes this and so gives it away
+    int64_t qwTime;
+    int64_t qwTimeNs;
+
+    // value of m_qwTick when it was last stored or fetched
+    uint64_t qwUsed;
+  };
+
+  // take the directory lock and read the index
+  bool Lock();
+
+  // write the index back and drop the lock
+  void Unlock();
+
+  // path of an output in the cache
+  std::string EntryPath(const std::string &x_szKey) const;
+
+  // finish the key off, once everything has been added
+  const std::string &GetKey();
+
+  // log how the cache has fared so far
+  void LogStats(const char *x_szOutcome);
+
+  std::string m_szDir;
+  uint64_t m_qwLimit;
+  bool m_bLink;
+
+  Sha1 m_Key;
+  std::string m_szKey;
+
+  // lock file descriptor, while the index is loaded
+  int m_fdLock{-1};
+
+  // index contents
+  std::vector<Entry> m_Entries;
+  uint64_t m_qwTick{0};
+  uint64_t m_qwHits{0};
+  uint64_t m_qwMisses{0};
+  uint64_t m_qwEvictions{0};
+};
+
+#endif
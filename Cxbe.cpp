@@ -21,11 +21,28 @@
 // *
 // ******************************************************************
 #include <string.h>
+#include <unistd.h>
 
 #include "Common.h"
+#include "ConvertCache.h"
 #include "Exe.h"
+#include "ExportPlan.h"
+#include "Log.h"
 #include "Xbe.h"
 
+// what the -PACK layouts do, printed after the usage
+static void ShowPackUsage() {
+  printf(
+      "\n"
+      "Pack :\n"
+      "\n"
+      "  file    packs the sections' raw data back to back in the file\n"
+      "  memory  moves data sections down to share their boundary pages in memory, keeping their offset within\n"
+      "          %d bytes (data aligned to more than that may end up misaligned)\n"
+      "  all     both\n",
+      XBE_SHARED_ALIGN);
+}
+
 // program entry point
 int main(int argc, char *argv[]) {
   char szErrorMessage[ERROR_LEN + 1] = {0};
@@ -34,18 +51,45 @@ int main(int argc, char *argv[]) {
   char szDumpFilename[OPTION_LEN + 1] = {0};
   char szXbeTitle[OPTION_LEN + 1] = "Untitled";
   char szMode[OPTION_LEN + 1] = "retail";
+  char szProfileFilename[OPTION_LEN + 1] = {0};
+  char szPack[OPTION_LEN + 1] = "none";
+  char szDigestFilename[OPTION_LEN + 1] = {0};
+  char szCacheDir[OPTION_LEN + 1] = {0};
+  char szCacheSize[OPTION_LEN + 1] = {0};
+  char szCacheLink[OPTION_LEN + 1] = "no";
   bool bRetail;
+  uint32 dwLayout;
+  uint64_t qwCacheLimit;
+  bool bCacheLink;
+  std::unique_ptr<ConvertCache> Cache;
+  std::vector<uint08> ExeImage;
+  int XbeStream = -1;
 
   const char *program = argv[0];
   const char *program_desc = "CXBE EXE to XBE (win32 to Xbox) Relinker (Version: " VERSION ")";
   Option options[] = {{szExeFilename, NULL, "exefile"},         {szXbeFilename, "OUT", "filename"},
                       {szDumpFilename, "DUMPINFO", "filename"}, {szXbeTitle, "TITLE", "title"},
-                      {szMode, "MODE", "{debug|retail}"},       {NULL}};
+                      {szMode, "MODE", "{debug|retail}"},       {szProfileFilename, "PROFILE", "filename"},
+                      {szPack, "PACK", "{none|file|memory|all}"}, {szDigestFilename, "DIGEST", "filename"},
+                      {szCacheDir, "CACHE", "directory"},         {szCacheSize, "CACHESIZE", "megabytes"},
+                      {szCacheLink, "CACHELINK", "{no|yes}"},     {NULL}};
 
   if (ParseOptions(argv, argc, options, szErrorMessage)) {
     goto cleanup;
   }
 
+  // "-" as output (the default for "-" as input) sends the Xbe to standard output, and progress to standard error
+  if (IsStdStream(szXbeFilename) || (szXbeFilename[0] == '\0' && IsStdStream(szExeFilename))) {
+    strncpy(szXbeFilename, "-", OPTION_LEN);
+
+    XbeStream = RedirectStdout();
+
+    if (XbeStream < 0) {
+      strncpy(szErrorMessage, "Unable to redirect standard output", ERROR_LEN);
+      goto cleanup;
+    }
+  }
+
   if (CompareString(szMode, "RETAIL"))
     bRetail = true;
   else if (CompareString(szMode, "DEBUG"))
@@ -55,6 +99,33 @@ int main(int argc, char *argv[]) {
     goto cleanup;
   }
 
+  if (CompareString(szPack, "NONE"))
+    dwLayout = XL_DEFAULT;
+  else if (CompareString(szPack, "FILE"))
+    dwLayout = XL_PACK_FILE;
+  else if (CompareString(szPack, "MEMORY"))
+    dwLayout = XL_SHARE_PAGES;
+  else if (CompareString(szPack, "ALL"))
+    dwLayout = XL_PACK_FILE | XL_SHARE_PAGES;
+  else {
+    strncpy(szErrorMessage, "invalid PACK", ERROR_LEN);
+    goto cleanup;
+  }
+
+  if (!ConvertCache::ParseLimit(szCacheSize, qwCacheLimit)) {
+    strncpy(szErrorMessage, "invalid CACHESIZE", ERROR_LEN);
+    goto cleanup;
+  }
+
+  if (CompareString(szCacheLink, "NO"))
+    bCacheLink = false;
+  else if (CompareString(szCacheLink, "YES"))
+    bCacheLink = true;
+  else {
+    strncpy(szErrorMessage, "invalid CACHELINK", ERROR_LEN);
+    goto cleanup;
+  }
+
   if (strlen(szXbeTitle) > 40) {
     printf("WARNING: Title too long, trimming\n");
     szXbeTitle[40] = '\0';
@@ -63,6 +134,7 @@ int main(int argc, char *argv[]) {
   // verify we received the required parameters
   if (szExeFilename[0] == '\0') {
     ShowUsage(program, program_desc, options);
+    ShowPackUsage();
     return 1;
   }
 
@@ -74,22 +146,67 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // an Exe converted the same way before is taken straight from the cache, without even being parsed
+  if (szCacheDir[0] != 0) {
+    if (XbeStream >= 0 || IsStdStream(szExeFilename) || szDumpFilename[0] != 0 || szDigestFilename[0] != 0) {
+      LogPrintf(LL_INFO, "CACHE -> Warning: Only used between files, and without DUMPINFO or DIGEST\n");
+    } else {
+      Cache.reset(new ConvertCache(szCacheDir, "cxbe", qwCacheLimit, bCacheLink));
+
+      Cache->AddOption("TITLE", szXbeTitle);
+      Cache->AddOption("MODE", bRetail ? "retail" : "debug");
+      Cache->AddOption("PACK", dwLayout & XL_SHARE_PAGES ? (dwLayout & XL_PACK_FILE ? "all" : "memory")
+                                                         : (dwLayout & XL_PACK_FILE ? "file" : "none"));
+      Cache->AddOption("PROFILE", szProfileFilename[0] != 0 ? "yes" : "no");
+
+      if (Cache->AddFile(szExeFilename) && (szProfileFilename[0] == 0 || Cache->AddFile(szProfileFilename)) &&
+          Cache->Fetch(szXbeFilename))
+        goto cleanup;
+
+      if (Cache->GetError() != 0) {
+        LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
+        Cache.reset();
+      }
+    }
+  }
+
   // open and convert Exe file
   {
-    Exe *ExeFile = new Exe(szExeFilename);
+    std::unique_ptr<Exe> ExeFile;
+
+    if (IsStdStream(szExeFilename)) {
+      if (!ReadStream(STDIN_FILENO, ExeImage)) {
+        strncpy(szErrorMessage, "Unable to read Exe from standard input", ERROR_LEN);
+        goto cleanup;
+      }
+
+      ExeFile.reset(new Exe(ExeImage.data(), (uint32)ExeImage.size()));
+    } else
+      ExeFile.reset(new Exe(szExeFilename));
 
     if (ExeFile->GetError() != 0) {
       strncpy(szErrorMessage, ExeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
 
-    Xbe *XbeFile = new Xbe(ExeFile, szXbeTitle, bRetail);
+    // the Exe is not needed afterwards, so its sections are handed over rather than copied
+    Xbe *XbeFile = new Xbe(std::move(ExeFile), szXbeTitle, bRetail, dwLayout);
 
     if (XbeFile->GetError() != 0) {
       strncpy(szErrorMessage, XbeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
 
+    // sections the profile never touches are left to be loaded on demand
+    if (szProfileFilename[0] != 0) {
+      XbeFile->ApplyPreloadProfile(szProfileFilename);
+
+      if (XbeFile->GetError() != 0) {
+        strncpy(szErrorMessage, XbeFile->GetError(), ERROR_LEN);
+        goto cleanup;
+      }
+    }
+
     if (szDumpFilename[0] != 0) {
       FILE *outfile = fopen(szDumpFilename, "wt");
       XbeFile->DumpInformation(outfile);
@@ -106,18 +223,47 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    XbeFile->Export(szXbeFilename);
+    // the digests are taken while the Xbe is written, rather than by reading it back
+    ExportDigest Digest(true);
+
+    ExportDigest *pDigest = szDigestFilename[0] != 0 ? &Digest : nullptr;
+
+    if (XbeStream >= 0)
+      XbeFile->ExportStream(XbeStream, pDigest);
+    else
+      XbeFile->Export(szXbeFilename, pDigest);
 
     if (XbeFile->GetError() != 0) {
       strncpy(szErrorMessage, XbeFile->GetError(), ERROR_LEN);
       goto cleanup;
     }
+
+    if (pDigest != nullptr) {
+      FILE *outfile = fopen(szDigestFilename, "wt");
+
+      if (outfile == NULL) {
+        strncpy(szErrorMessage, "Unable to open DIGEST file", ERROR_LEN);
+        goto cleanup;
+      }
+
+      fprintf(outfile, "header ");
+      for (int s = 0; s < SHA1_DIGEST_SIZE; s++) fprintf(outfile, "%.02x", Digest.GetHeader()[s]);
+
+      fprintf(outfile, "\nfile   ");
+      for (int s = 0; s < SHA1_DIGEST_SIZE; s++) fprintf(outfile, "%.02x", Digest.GetFile()[s]);
+
+      fprintf(outfile, "\n");
+      fclose(outfile);
+    }
+
+    if (Cache && !Cache->Store(szXbeFilename)) LogPrintf(LL_INFO, "CACHE -> Warning: %s\n", Cache->GetError());
   }
 
 cleanup:
 
   if (szErrorMessage[0] != 0) {
     ShowUsage(program, program_desc, options);
+    ShowPackUsage();
 
     printf("\n");
     printf(" *  Error : %s\n", szErrorMessage);
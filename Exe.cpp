@@ -33,14 +33,42 @@
 // ******************************************************************
 #include "Exe.h"
 
+#include <fcntl.h>
 #include <memory.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#include "Common.h"
+#include "ExportPlan.h"
+#include "Log.h"
 
 // construct via Exe file
-Exe::Exe(const char *x_szFilename) {
+Exe::Exe(const char *x_szFilename, LoadMode x_Mode) {
   ConstructorInit();
 
-  printf("Exe::Exe: Opening Exe file...");
+  // map the whole file once and parse it in place
+  if (x_Mode == LM_MAPPED) {
+    LogPrintf(LL_INFO, "Exe::Exe: Mapping Exe file...");
+
+    std::shared_ptr<MappedFile> File = std::make_shared<MappedFile>();
+
+    if (File->Open(x_szFilename)) {
+      LogPrintf(LL_INFO, "OK\n");
+
+      m_File = File;
+
+      ParseImage(File->GetData(), File->GetSize());
+
+      if (GetError() == 0) LogPrintf(LL_INFO, "Exe::Exe: Exe %s was successfully opened.\n", x_szFilename);
+
+      return;
+    }
+
+    // not a regular file (or mmap is unavailable), fall back to reading it
+    LogPrintf(LL_INFO, "Unavailable, reading instead\n");
+  }
+
+  LogPrintf(LL_INFO, "Exe::Exe: Opening Exe file...");
 
   FILE *ExeFile = fopen(x_szFilename, "rb");
 
@@ -50,11 +78,34 @@ Exe::Exe(const char *x_szFilename) {
     goto cleanup;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
+
+  // a pipe cannot seek to what the headers point at, so read it whole and parse it in memory like standard input
+  if (!IsSeekable(fileno(ExeFile))) {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading unseekable Exe file into memory...");
+
+    bool bRead = ReadStream(fileno(ExeFile), m_Stream);
+
+    fclose(ExeFile);
+    ExeFile = NULL;
+
+    if (!bRead) {
+      SetError("Could not read Exe file", true);
+      goto cleanup;
+    }
+
+    LogPrintf(LL_INFO, "OK\n");
+
+    ParseImage(m_Stream.data(), (uint32)m_Stream.size());
+
+    if (GetError() == 0) LogPrintf(LL_INFO, "Exe::Exe: Exe %s was successfully opened.\n", x_szFilename);
+
+    return;
+  }
 
   // ignore dos stub (if exists)
   {
-    printf("Exe::Exe: Reading DOS stub...");
+    LogPrintf(LL_INFO, "Exe::Exe: Reading DOS stub...");
 
     if (fread(&m_DOSHeader.m_magic, sizeof(m_DOSHeader.m_magic), 1, ExeFile) != 1) {
       SetError("Unexpected read error while reading magic number", true);
@@ -62,7 +113,7 @@ Exe::Exe(const char *x_szFilename) {
     }
 
     if (m_DOSHeader.m_magic == *(uint16 *)"MZ") {
-      printf("Found, Ignoring...");
+      LogPrintf(LL_INFO, "Found, Ignoring...");
 
       if (fread(&m_DOSHeader.m_cblp, sizeof(m_DOSHeader) - 2, 1, ExeFile) != 1) {
         SetError("Unexpected read error while reading DOS stub", true);
@@ -79,17 +130,20 @@ Exe::Exe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      fseek(ExeFile, m_DOSHeader.m_lfanew, SEEK_SET);
+      if (fseek(ExeFile, m_DOSHeader.m_lfanew, SEEK_SET)) {
+        SetError("Failed to seek to PE header", true);
+        goto cleanup;
+      }
 
-      printf("OK\n");
+      LogPrintf(LL_INFO, "OK\n");
     } else {
-      printf("None (OK)\n");
+      LogPrintf(LL_INFO, "None (OK)\n");
     }
   }
 
   // read PE header
   {
-    printf("Exe::Exe: Reading PE header...");
+    LogPrintf(LL_INFO, "Exe::Exe: Reading PE header...");
 
     if (fread(&m_Header, sizeof(m_Header), 1, ExeFile) != 1) {
       SetError("Unexpected read error while reading PE header", true);
@@ -101,12 +155,12 @@ Exe::Exe(const char *x_szFilename) {
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
   // read optional header
   {
-    printf("Exe::Exe: Reading Optional Header...");
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Optional Header...");
 
     if (fread(&m_OptionalHeader, sizeof(m_OptionalHeader), 1, ExeFile) != 1) {
       SetError("Unexpected read error while reading PE optional header", true);
@@ -118,17 +172,17 @@ Exe::Exe(const char *x_szFilename) {
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
   // read section headers
   {
     m_SectionHeader = new SectionHeader[m_Header.m_sections];
 
-    printf("Exe::Exe: Reading Section Headers...\n");
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Section Headers...\n");
 
     for (uint32 v = 0; v < m_Header.m_sections; v++) {
-      printf("Exe::Exe: Reading Section Header 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Exe::Exe: Reading Section Header 0x%.04X...", v);
 
       if (fread(&m_SectionHeader[v], sizeof(SectionHeader), 1, ExeFile) != 1) {
         char buffer[255];
@@ -137,36 +191,35 @@ Exe::Exe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      printf("OK %d\n", v);
+      LogPrintf(LL_VERBOSE, "OK %d\n", v);
     }
   }
 
   // read sections
   {
-    printf("Exe::Exe: Reading Sections...\n");
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Sections...\n");
 
-    m_bzSection = new uint08 *[m_Header.m_sections];
+    m_bzSection = new uint08 *[m_Header.m_sections]();
+    m_dwSectionSize = new uint32[m_Header.m_sections]();
 
     for (uint32 v = 0; v < m_Header.m_sections; v++) {
-      printf("Exe::Exe: Reading Section 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Exe::Exe: Reading Section 0x%.04X...", v);
 
       uint32 raw_size = m_SectionHeader[v].m_sizeof_raw;
       uint32 raw_addr = m_SectionHeader[v].m_raw_addr;
 
+      // no need to clear this first, fread fills all of it (or fails)
       m_bzSection[v] = new uint08[raw_size];
-
-      memset(m_bzSection[v], 0, raw_size);
+      m_dwSectionSize[v] = raw_size;
 
       if (raw_size == 0) {
-        printf("OK\n");
+        LogPrintf(LL_VERBOSE, "OK\n");
         continue;
       }
 
       // read current section from file (if raw_size > 0)
       {
-        fseek(ExeFile, raw_addr, SEEK_SET);
-
-        if (fread(m_bzSection[v], raw_size, 1, ExeFile) != 1) {
+        if (fseek(ExeFile, raw_addr, SEEK_SET) != 0 || fread(m_bzSection[v], raw_size, 1, ExeFile) != 1) {
           char buffer[255];
           sprintf(buffer, "Could not read PE section %d (%Xh)", v, v);
           SetError(buffer, true);
@@ -174,17 +227,19 @@ Exe::Exe(const char *x_szFilename) {
         }
       }
 
-      printf("OK\n");
+      LogPrintf(LL_VERBOSE, "OK\n");
     }
   }
 
-  printf("Exe::Exe: Exe %s was successfully opened.\n", x_szFilename);
+  IndexSections();
+
+  LogPrintf(LL_INFO, "Exe::Exe: Exe %s was successfully opened.\n", x_szFilename);
 
 cleanup:
 
   if (GetError() != 0) {
-    printf("FAILED!\n");
-    printf("Exe::Exe: ERROR -> %s\n", GetError());
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Exe::Exe: ERROR -> %s\n", GetError());
   }
 
   if (ExeFile != NULL) {
@@ -195,153 +250,468 @@ cleanup:
   return;
 }
 
+// construct via Exe image already in memory
+Exe::Exe(uint08 *x_pImage, uint32 x_dwSize) {
+  ConstructorInit();
+
+  ParseImage(x_pImage, x_dwSize);
+}
+
+// parse an Exe image that is already in memory, pointing into it instead of copying
+void Exe::ParseImage(uint08 *x_pImage, uint32 x_dwSize) {
+  // offset of the PE header
+  uint32 PEOffs = 0;
+
+  m_pImage = x_pImage;
+  m_dwImageSize = x_dwSize;
+
+  // ignore dos stub (if exists)
+  {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading DOS stub...");
+
+    if (x_dwSize < sizeof(m_DOSHeader.m_magic)) {
+      SetError("Unexpected read error while reading magic number", true);
+      goto cleanup;
+    }
+
+    if (*(uint16 *)x_pImage == *(uint16 *)"MZ") {
+      LogPrintf(LL_INFO, "Found, Ignoring...");
+
+      if (x_dwSize < sizeof(m_DOSHeader)) {
+        SetError("Unexpected read error while reading DOS stub", true);
+        goto cleanup;
+      }
+
+      memcpy(&m_DOSHeader, x_pImage, sizeof(m_DOSHeader));
+
+      if (m_DOSHeader.m_lfanew > x_dwSize) {
+        SetError("Failed to read DOS header + stub", true);
+        goto cleanup;
+      }
+
+      m_bzDOSStub = x_pImage;
+
+      PEOffs = m_DOSHeader.m_lfanew;
+
+      LogPrintf(LL_INFO, "OK\n");
+    } else {
+      LogPrintf(LL_INFO, "None (OK)\n");
+    }
+  }
+
+  // read PE header
+  {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading PE header...");
+
+    if (x_dwSize - PEOffs < sizeof(m_Header)) {
+      SetError("Unexpected read error while reading PE header", true);
+      goto cleanup;
+    }
+
+    memcpy(&m_Header, &x_pImage[PEOffs], sizeof(m_Header));
+
+    if (m_Header.m_magic != *(uint32 *)"PE\0\0") {
+      SetError("Invalid file (could not locate PE header)", true);
+      goto cleanup;
+    }
+
+    PEOffs += sizeof(m_Header);
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // read optional header
+  {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Optional Header...");
+
+    if (x_dwSize - PEOffs < sizeof(m_OptionalHeader)) {
+      SetError("Unexpected read error while reading PE optional header", true);
+      goto cleanup;
+    }
+
+    memcpy(&m_OptionalHeader, &x_pImage[PEOffs], sizeof(m_OptionalHeader));
+
+    if (m_OptionalHeader.m_magic != 0x010B) {
+      SetError("Invalid file (could not locate PE optional header)", true);
+      goto cleanup;
+    }
+
+    PEOffs += sizeof(m_OptionalHeader);
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // locate section headers
+  {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Section Headers...");
+
+    if (x_dwSize - PEOffs < (uint64_t)m_Header.m_sections * sizeof(SectionHeader)) {
+      SetError("Could not read PE section headers", true);
+      goto cleanup;
+    }
+
+    m_SectionHeader = (SectionHeader *)&x_pImage[PEOffs];
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // locate sections
+  {
+    LogPrintf(LL_INFO, "Exe::Exe: Reading Sections...\n");
+
+    m_bzSection = new uint08 *[m_Header.m_sections]();
+    m_dwSectionSize = new uint32[m_Header.m_sections]();
+
+    for (uint32 v = 0; v < m_Header.m_sections; v++) {
+      LogPrintf(LL_VERBOSE, "Exe::Exe: Reading Section 0x%.04X...", v);
+
+      uint32 raw_size = m_SectionHeader[v].m_sizeof_raw;
+      uint32 raw_addr = m_SectionHeader[v].m_raw_addr;
+
+      // sections without raw data have nothing to point at (they are zero filled on demand)
+      if (raw_size == 0) raw_addr = 0;
+
+      if (raw_addr > x_dwSize || x_dwSize - raw_addr < raw_size) {
+        char buffer[255];
+        sprintf(buffer, "Could not read PE section %d (%Xh)", v, v);
+        SetError(buffer, true);
+        goto cleanup;
+      }
+
+      m_bzSection[v] = &x_pImage[raw_addr];
+      m_dwSectionSize[v] = raw_size;
+
+      LogPrintf(LL_VERBOSE, "OK\n");
+    }
+
+    IndexSections();
+  }
+
+cleanup:
+
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Exe::Exe: ERROR -> %s\n", GetError());
+  }
+
+  return;
+}
+
 // constructor initialization
 void Exe::ConstructorInit() {
   m_SectionHeader = 0;
   m_bzSection = 0;
+  m_dwSectionSize = 0;
+}
+
+// is this buffer part of the in-memory image (and therefore not ours to free)?
+bool Exe::IsImageBuffer(const void *x_pBuffer) const {
+  const uint08 *p = (const uint08 *)x_pBuffer;
+
+  // the end is included so that zero sized sections at the very end of the image are covered
+  return m_pImage != nullptr && p >= m_pImage && p <= m_pImage + m_dwImageSize;
+}
+
+// is this section's buffer ours to free?
+bool Exe::OwnsSection(uint32 x_dwSection) const {
+  if (x_dwSection < m_SectionView.size() && m_SectionView[x_dwSection]) return false;
+
+  return !IsImageBuffer(m_bzSection[x_dwSection]);
 }
 
 // deconstructor
 Exe::~Exe() {
+  // anything pointing into the in-memory image is released along with it, views belong to someone else
   if (m_bzSection != 0) {
-    for (uint32 v = 0; v < m_Header.m_sections; v++) delete[] m_bzSection[v];
+    for (uint32 v = 0; v < m_Header.m_sections; v++)
+      if (OwnsSection(v)) delete[] m_bzSection[v];
 
     delete[] m_bzSection;
   }
 
-  if (m_bzDOSStub) {
+  if (m_bzDOSStub && !IsImageBuffer(m_bzDOSStub)) {
     delete[] m_bzDOSStub;
   }
 
-  delete[] m_SectionHeader;
+  if (!IsImageBuffer(m_SectionHeader)) delete[] m_SectionHeader;
+
+  delete[] m_dwSectionSize;
+}
+
+// return section data with at least x_dwSize bytes available, zero filling past the raw data on demand
+uint08 *Exe::GetSection(uint32 x_dwSection, uint32 x_dwSize) {
+  if (x_dwSize <= m_dwSectionSize[x_dwSection]) return m_bzSection[x_dwSection];
+
+  uint08 *bzSection = new uint08[x_dwSize];
+
+  memcpy(bzSection, m_bzSection[x_dwSection], m_dwSectionSize[x_dwSection]);
+  memset(&bzSection[m_dwSectionSize[x_dwSection]], 0, x_dwSize - m_dwSectionSize[x_dwSection]);
+
+  if (OwnsSection(x_dwSection)) delete[] m_bzSection[x_dwSection];
+
+  // a grown view is a copy of its own
+  if (x_dwSection < m_SectionView.size()) {
+    m_SectionView[x_dwSection] = false;
+    m_SectionViewFile[x_dwSection] = nullptr;
+  }
+
+  m_bzSection[x_dwSection] = bzSection;
+  m_dwSectionSize[x_dwSection] = x_dwSize;
+
+  return bzSection;
+}
+
+// let a section point at x_dwSize bytes owned by someone else
+void Exe::SetSectionView(uint32 x_dwSection, uint08 *x_pData, uint32 x_dwSize, std::shared_ptr<MappedFile> x_File) {
+  if (OwnsSection(x_dwSection)) delete[] m_bzSection[x_dwSection];
+
+  if (m_SectionView.size() < m_Header.m_sections) {
+    m_SectionView.resize(m_Header.m_sections);
+    m_SectionViewFile.resize(m_Header.m_sections);
+  }
+
+  m_SectionView[x_dwSection] = true;
+  m_SectionViewFile[x_dwSection] = x_File;
+
+  m_bzSection[x_dwSection] = x_pData;
+  m_dwSectionSize[x_dwSection] = x_dwSize;
+}
+
+// hand section data with at least x_dwSize bytes available over to the caller
+uint08 *Exe::ReleaseSection(uint32 x_dwSection, uint32 x_dwSize) {
+  uint08 *bzSection = GetSection(x_dwSection, x_dwSize);
+
+  // a mapping is shared through GetFile, but a buffer given to the constructor or a view is never ours to give away
+  if (!OwnsSection(x_dwSection) && (m_File == nullptr || !IsImageBuffer(bzSection))) return nullptr;
+
+  m_bzSection[x_dwSection] = nullptr;
+  m_dwSectionSize[x_dwSection] = 0;
+
+  return bzSection;
 }
 
 // export to Exe file
 void Exe::Export(const char *x_szExeFilename) {
   if (GetError() != 0) return;
 
-  printf("Exe::Export: Opening Exe file...");
+  ExportPlan Plan;
+
+  LogPrintf(LL_INFO, "Exe::Export: Opening Exe file...");
 
-  FILE *ExeFile = fopen(x_szExeFilename, "wb");
+  // written under a temporary name and renamed into place, as the file may well be the one this Exe is mapped from
+  std::string szTemp;
+
+  int ExeFile = OpenReplacement(x_szExeFilename, szTemp);
 
   // verify Exe file was opened successfully
-  if (ExeFile == NULL) {
+  if (ExeFile < 0) {
     SetError("Could not open Exe file", true);
     goto cleanup;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
 
-  // write dos stub
+  // lay out the whole file before writing any of it
   {
-    printf("Exe::Export: Writing DOS stub...");
+    LogPrintf(LL_INFO, "Exe::Export: Planning Layout...");
 
-    if (fwrite(m_bzDOSStub, m_DOSHeader.m_lfanew, 1, ExeFile) != 1) {
-      SetError("Could not write dos stub", false);
-      goto cleanup;
-    }
+    PlanExport(Plan);
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
   }
 
-  // write pe header
+  // emit the file front to back, sections that are not back to back are separated by holes
   {
-    printf("Exe::Export: Writing PE Header...");
+    LogPrintf(LL_INFO, "Exe::Export: Writing Exe file...");
 
-    if (fwrite(&m_Header, sizeof(Header), 1, ExeFile) != 1) {
-      SetError("Could not write PE header", false);
+    if (!Plan.Write(ExeFile)) {
+      SetError("Could not write Exe file", false);
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
-  // write optional header
-  {
-    printf("Exe::Export: Writing Optional Header...");
+cleanup:
 
-    if (fwrite(&m_OptionalHeader, sizeof(OptionalHeader), 1, ExeFile) != 1) {
-      SetError("Could not write PE optional header", false);
-      goto cleanup;
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Exe::Export: ERROR -> %s\n", GetError());
+  }
+
+  if (ExeFile >= 0) {
+    if (!FinishReplacement(ExeFile, szTemp, x_szExeFilename, GetError() == 0) && GetError() == 0) {
+      SetError("Could not replace Exe file", false);
+      LogPrintf(LL_ERROR, "Exe::Export: ERROR -> %s\n", GetError());
     }
 
-    printf("OK\n");
+    ExeFile = -1;
   }
 
-  // write section header
-  {
-    printf("Exe::Export: Writing Section Headers...\n");
+  return;
+}
 
-    for (uint32 v = 0; v < m_Header.m_sections; v++) {
-      printf("Exe::Export: Writing Section Header 0x%.04X [%8s]...", v, m_SectionHeader[v].m_name);
+// export to memory buffer
+void Exe::Export(std::vector<uint08> &x_Buffer) {
+  if (GetError() != 0) return;
 
-      if (fwrite(&m_SectionHeader[v], sizeof(SectionHeader), 1, ExeFile) != 1) {
-        char buffer[255];
-        sprintf(buffer, "Could not write PE section header %d (%Xh)", v, v);
-        SetError(buffer, false);
-        goto cleanup;
-      }
+  ExportPlan Plan;
 
-      printf("OK\n");
-    }
+  LogPrintf(LL_INFO, "Exe::Export: Planning Layout...");
+
+  PlanExport(Plan);
+
+  LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
+
+  LogPrintf(LL_INFO, "Exe::Export: Writing Exe image...");
+
+  Plan.Write(x_Buffer);
+
+  LogPrintf(LL_INFO, "OK\n");
+}
+
+// export to an open file descriptor
+void Exe::ExportStream(int x_fd) {
+  if (GetError() != 0) return;
+
+  ExportPlan Plan;
+
+  LogPrintf(LL_INFO, "Exe::ExportStream: Planning Layout...");
+
+  PlanExport(Plan);
+
+  LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
+
+  // nothing may be written before the whole layout is known, as there is no seeking back
+  LogPrintf(LL_INFO, "Exe::ExportStream: Streaming Exe file...");
+
+  if (!Plan.Stream(x_fd)) {
+    SetError("Unexpected write error while streaming Exe file", false);
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Exe::ExportStream: ERROR -> %s\n", GetError());
+    return;
   }
 
-  // write sections
-  {
-    printf("Exe::Export: Writing Sections...\n");
+  LogPrintf(LL_INFO, "OK\n");
+}
 
-    for (uint32 v = 0; v < m_Header.m_sections; v++) {
-      printf("Exe::Export: Writing Section 0x%.04X [%8.8s]...", v, m_SectionHeader[v].m_name);
+// lay out everything Export writes, in file order
+void Exe::PlanExport(ExportPlan &x_Plan) {
+  uint32 dwOffset = 0;
 
-      uint32 RawSize = m_SectionHeader[v].m_sizeof_raw;
-      uint32 RawAddr = m_SectionHeader[v].m_raw_addr;
+  // dos stub
+  if (m_bzDOSStub != nullptr) {
+    x_Plan.Add(0, m_bzDOSStub, m_DOSHeader.m_lfanew);
 
-      printf("\tRawSize: 0x%X  RawAddr: 0x%X\n", RawSize, RawAddr);
+    dwOffset = m_DOSHeader.m_lfanew;
+  }
 
-      fseek(ExeFile, RawAddr, SEEK_SET);
+  // pe header, optional header and section headers are back to back
+  x_Plan.Add(dwOffset, &m_Header, sizeof(Header));
 
-      if (RawSize == 0) {
-        printf("OK\n");
-        continue;
-      }
+  dwOffset += sizeof(Header);
 
-      if (fwrite(m_bzSection[v], RawSize, 1, ExeFile) != 1) {
-        char buffer[255];
-        sprintf(buffer, "Could not write PE section %d (%Xh)", v, v);
-        SetError(buffer, false);
-        goto cleanup;
-      }
+  x_Plan.Add(dwOffset, &m_OptionalHeader, sizeof(OptionalHeader));
 
-      fflush(ExeFile);
+  dwOffset += sizeof(OptionalHeader);
 
-      printf("OK\n");
-    }
+  x_Plan.Add(dwOffset, m_SectionHeader, m_Header.m_sections * sizeof(SectionHeader));
+
+  // sections, anything past the data we have reads as zeros
+  for (uint32 v = 0; v < m_Header.m_sections; v++) {
+    uint32 RawSize = m_SectionHeader[v].m_sizeof_raw;
+    uint32 RawAddr = m_SectionHeader[v].m_raw_addr;
+
+    if (RawSize == 0) continue;
+
+    // unmodified data from a mapped file (our own or a view's) can be copied from there
+    const MappedFile *File = m_File.get();
+
+    if (v < m_SectionView.size() && m_SectionView[v]) File = m_SectionViewFile[v].get();
+
+    x_Plan.Add(RawAddr, m_bzSection[v], RawSize < m_dwSectionSize[v] ? RawSize : m_dwSectionSize[v], File);
+    x_Plan.Extend(RawAddr + RawSize);
   }
+}
 
-cleanup:
+// pointer to the data held for a relative virtual address, without touching any section
+const uint08 *Exe::GetAddr(uint32 x_dwVirtualAddress) const {
+  sint32 v = -1;
 
-  if (GetError() != 0) {
-    printf("FAILED!\n");
-    printf("Exe::Export: ERROR -> %s\n", GetError());
+  if (m_SectionIndex.IsBuilt())
+    v = m_SectionIndex.Find(x_dwVirtualAddress);
+  else {
+    for (uint32 s = 0; s < m_Header.m_sections && v < 0; s++)
+      if (x_dwVirtualAddress - m_SectionHeader[s].m_virtual_addr < m_SectionHeader[s].m_virtual_size) v = s;
   }
 
-  if (ExeFile != NULL) {
-    fclose(ExeFile);
-    ExeFile = NULL;
+  if (v < 0) return 0;
+
+  uint32 dwOffs = x_dwVirtualAddress - m_SectionHeader[v].m_virtual_addr;
+
+  // the part of a section past its raw data is not held anywhere (it reads as zeros through Read)
+  if (dwOffs >= m_dwSectionSize[v]) return 0;
+
+  return &m_bzSection[v][dwOffs];
+}
+
+// copy x_dwSize bytes at a relative virtual address out of a single section without modifying it
+bool Exe::Read(uint32 x_dwVirtualAddress, void *x_pData, uint32 x_dwSize) const {
+  sint32 v = -1;
+
+  if (m_SectionIndex.IsBuilt())
+    v = m_SectionIndex.Find(x_dwVirtualAddress);
+  else {
+    for (uint32 s = 0; s < m_Header.m_sections && v < 0; s++)
+      if (x_dwVirtualAddress - m_SectionHeader[s].m_virtual_addr < m_SectionHeader[s].m_virtual_size) v = s;
   }
 
-  return;
+  if (v < 0) return false;
+
+  uint32 dwOffs = x_dwVirtualAddress - m_SectionHeader[v].m_virtual_addr;
+
+  if (x_dwSize > m_SectionHeader[v].m_virtual_size - dwOffs) return false;
+
+  // the part of a section past its raw data reads as zeros
+  uint32 dwRaw = dwOffs < m_dwSectionSize[v] ? m_dwSectionSize[v] - dwOffs : 0;
+
+  if (dwRaw > x_dwSize) dwRaw = x_dwSize;
+
+  if (dwRaw != 0) memcpy(x_pData, &m_bzSection[v][dwOffs], dwRaw);
+
+  memset((uint08 *)x_pData + dwRaw, 0, x_dwSize - dwRaw);
+
+  return true;
 }
 
-// return a modifiable pointer inside this structure that corresponds to a virtual address
-uint08 *Exe::GetAddr(uint32 x_dwVirtualAddress) {
-  for (uint32 v = 0; v < m_Header.m_sections; v++) {
-    uint32 virt_addr = m_SectionHeader[v].m_virtual_addr;
-    uint32 virt_size = m_SectionHeader[v].m_virtual_size;
+// resolve x_dwCount relative virtual addresses at once
+void Exe::GetAddrs(const uint32 *x_dwVirtualAddresses, const uint08 **x_pAddrs, uint32 x_dwCount) const {
+  if (!m_SectionIndex.IsBuilt()) {
+    for (uint32 v = 0; v < x_dwCount; v++) x_pAddrs[v] = GetAddr(x_dwVirtualAddresses[v]);
+
+    return;
+  }
 
-    if ((x_dwVirtualAddress >= virt_addr) && (x_dwVirtualAddress < (virt_addr + virt_size)))
-      return &m_bzSection[v][x_dwVirtualAddress - virt_addr];
+  std::vector<sint32> Sections(x_dwCount);
+
+  m_SectionIndex.FindSorted(x_dwVirtualAddresses, Sections.data(), x_dwCount);
+
+  for (uint32 v = 0; v < x_dwCount; v++) {
+    sint32 s = Sections[v];
+
+    uint32 dwOffs = s < 0 ? 0 : x_dwVirtualAddresses[v] - m_SectionHeader[s].m_virtual_addr;
+
+    x_pAddrs[v] = (s < 0 || dwOffs >= m_dwSectionSize[s]) ? 0 : &m_bzSection[s][dwOffs];
   }
+}
+
+// (re)build the section lookup index
+void Exe::IndexSections() {
+  m_SectionIndex.Clear();
+
+  for (uint32 v = 0; v < m_Header.m_sections; v++)
+    m_SectionIndex.Add(v, m_SectionHeader[v].m_virtual_addr, m_SectionHeader[v].m_virtual_size);
 
-  return 0;
+  // overlapping sections are left to the linear scan
+  m_SectionIndex.Build();
 }
\ No newline at end of file
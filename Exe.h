@@ -34,15 +34,24 @@
 #ifndef EXE_H
 #define EXE_H
 
+#include <memory>
+#include <vector>
+
 #include "Error.h"
+#include "MappedFile.h"
+#include "SectionIndex.h"
 
 // Exe (PE) file object
 class Exe : public Error {
  public:
   Exe() = default;
 
-  // construct via Exe file
-  Exe(const char *x_szFilename);
+  // construct via Exe file (by default the file is mapped and sections point into it)
+  Exe(const char *x_szFilename, LoadMode x_Mode = LM_MAPPED);
+
+  // construct via Exe image already in memory (the buffer stays the caller's and must outlive this object);
+  // headers and sections are parsed in place, so relocating them or editing the headers writes into the buffer
+  Exe(uint08 *x_pImage, uint32 x_dwSize);
 
   // deconstructor
   ~Exe();
@@ -50,6 +59,12 @@ class Exe : public Error {
   // export to Exe file
   void Export(const char *x_szExeFilename);
 
+  // export to memory buffer (replacing its contents)
+  void Export(std::vector<uint08> &x_Buffer);
+
+  // export to an open file descriptor, written front to back so that pipes work
+  void ExportStream(int x_fd);
+
   // DOSHeader
 #include "AlignPrefix1.h"
   struct DOSHeader {
@@ -154,14 +169,76 @@ class Exe : public Error {
   // array of section data
   uint08 **m_bzSection{nullptr};
 
+  // number of bytes available in each m_bzSection buffer
+  uint32 *m_dwSectionSize{nullptr};
+
   uint08 *m_bzDOSStub{nullptr};
 
+  // return section data with at least x_dwSize bytes available, zero filling past the raw data on demand
+  uint08 *GetSection(uint32 x_dwSection, uint32 x_dwSize);
+
+  // hand section data with at least x_dwSize bytes available over to the caller, who frees it unless it lies in
+  // GetFile()'s mapping (nullptr if it lies in an image the caller of the constructor still owns)
+  uint08 *ReleaseSection(uint32 x_dwSection, uint32 x_dwSize);
+
+  // let a section point at x_dwSize bytes owned by someone else, who must keep them alive as long as this Exe
+  // (if they lie in x_File's mapping, export copies them from the file where they are unmodified)
+  void SetSectionView(uint32 x_dwSection, uint08 *x_pData, uint32 x_dwSize,
+                      std::shared_ptr<MappedFile> x_File = nullptr);
+
+  // mapping backing the sections (if the Exe came from a file)
+  std::shared_ptr<MappedFile> GetFile() const { return m_File; }
+
+  // pointer to the data held for a relative virtual address, or 0 if it lies outside every section or past
+  // the raw data of its section (which reads as zeros, see Read); no section is loaded or copied for it
+  const uint08 *GetAddr(uint32 x_dwVirtualAddress) const;
+
+  // copy x_dwSize bytes at a relative virtual address out of a single section without modifying it (what
+  // lies past its raw data reads as zeros), returns false if they are not all inside one section
+  bool Read(uint32 x_dwVirtualAddress, void *x_pData, uint32 x_dwSize) const;
+
+  // GetAddr for x_dwCount relative virtual addresses at once, in a single pass when they are sorted
+  // ascending, as in a relocation block or a thunk table
+  void GetAddrs(const uint32 *x_dwVirtualAddresses, const uint08 **x_pAddrs, uint32 x_dwCount) const;
+
+  // (re)build the section lookup index, needed again whenever section addresses or sizes change
+  void IndexSections();
+
  protected:
   // constructor initialization
   void ConstructorInit();
 
-  // return a modifiable pointer inside this structure that corresponds to a virtual address
-  uint08 *GetAddr(uint32 x_dwVirtualAddress);
+ private:
+  // parse an Exe image that is already in memory, pointing into it instead of copying
+  void ParseImage(uint08 *x_pImage, uint32 x_dwSize);
+
+  // is this buffer part of the in-memory image (and therefore not ours to free)?
+  bool IsImageBuffer(const void *x_pBuffer) const;
+
+  // is this section's buffer ours to free (neither in the in-memory image nor a view)?
+  bool OwnsSection(uint32 x_dwSection) const;
+
+  // lay out everything Export writes, in file order
+  void PlanExport(class ExportPlan &x_Plan);
+
+  // in-memory image that headers and sections may point into
+  uint08 *m_pImage{nullptr};
+  uint32 m_dwImageSize{0};
+
+  // mapping backing m_pImage (if it came from a file)
+  std::shared_ptr<MappedFile> m_File;
+
+  // contents backing m_pImage (if they came from a file that could not seek)
+  std::vector<uint08> m_Stream;
+
+  // sections set up by SetSectionView (empty if there are none)
+  std::vector<bool> m_SectionView;
+
+  // mapping each view lies in (if any)
+  std::vector<std::shared_ptr<MappedFile>> m_SectionViewFile;
+
+  // finds the section holding a relative virtual address
+  SectionIndex m_SectionIndex;
 };
 
 // PE file/segment alignments : these must always both equal 0x0020
@@ -0,0 +1,353 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "ExportPlan.h"
+
+#include "MappedFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+// write the whole iovec array at x_offset (or at the current position if x_offset is negative), picking up after short writes
+static bool WriteFully(int x_fd, struct iovec *x_iov, int x_count, off_t x_offset) {
+  while (x_count > 0) {
+    ssize_t written = x_offset < 0 ? writev(x_fd, x_iov, x_count) : pwritev(x_fd, x_iov, x_count, x_offset);
+
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    if (x_offset >= 0) x_offset += written;
+
+    // skip what has been written
+    while (x_count > 0 && (size_t)written >= x_iov->iov_len) {
+      written -= x_iov->iov_len;
+      x_iov++;
+      x_count--;
+    }
+
+    if (x_count > 0) {
+      x_iov->iov_base = (uint08 *)x_iov->iov_base + written;
+      x_iov->iov_len -= written;
+    }
+  }
+
+  return true;
+}
+
+// copy x_dwSize bytes between two files inside the kernel (sharing the blocks where the filesystem can),
+// returns false if that did not (fully) work
+static bool CopyRange(int x_fdIn, uint32 x_dwInOffset, int x_fdOut, uint32 x_dwOutOffset, uint32 x_dwSize) {
+#ifdef __linux__
+  loff_t in = x_dwInOffset;
+  loff_t out = x_dwOutOffset;
+
+  while (x_dwSize > 0) {
+    ssize_t copied = copy_file_range(x_fdIn, &in, x_fdOut, &out, x_dwSize, 0);
+
+    if (copied < 0 && errno == EINTR) continue;
+
+    if (copied <= 0) return false;
+
+    x_dwSize -= (uint32)copied;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+// digest [x_dwBegin, x_dwEnd) of the file as its header
+void ExportDigest::SetHeader(uint32 x_dwBegin, uint32 x_dwEnd) {
+  m_dwHeaderBegin = x_dwBegin;
+  m_dwHeaderEnd = x_dwEnd > x_dwBegin ? x_dwEnd : x_dwBegin;
+
+  uint32 dwLength = m_dwHeaderEnd - m_dwHeaderBegin;
+
+  m_Header.Reset();
+  m_Header.Update(&dwLength, 4);
+}
+
+// x_dwSize bytes written at x_dwOffset
+void ExportDigest::Update(uint32 x_dwOffset, const uint08 *x_pData, uint32 x_dwSize) {
+  if (x_dwOffset > m_dwPos) Feed(0, x_dwOffset - m_dwPos);
+
+  Feed(x_pData, x_dwSize);
+}
+
+// the file is complete at x_dwSize bytes
+void ExportDigest::Final(uint32 x_dwSize) {
+  if (x_dwSize > m_dwPos) Feed(0, x_dwSize - m_dwPos);
+
+  m_Header.Final(m_HeaderDigest);
+
+  if (m_bFile) m_File.Final(m_FileDigest);
+}
+
+// the next x_dwSize bytes of the file
+void ExportDigest::Feed(const uint08 *x_pData, uint32 x_dwSize) {
+  static const uint08 Zeros[0x1000] = {0};
+
+  while (x_dwSize > 0) {
+    uint32 dwSize = x_dwSize;
+
+    if (x_pData == 0 && dwSize > sizeof(Zeros)) dwSize = sizeof(Zeros);
+
+    const uint08 *pData = (x_pData != 0) ? x_pData : Zeros;
+
+    // the part that falls in the header range
+    uint32 dwBegin = m_dwPos > m_dwHeaderBegin ? m_dwPos : m_dwHeaderBegin;
+    uint32 dwEnd = m_dwPos + dwSize < m_dwHeaderEnd ? m_dwPos + dwSize : m_dwHeaderEnd;
+
+    if (dwBegin < dwEnd) m_Header.Update(&pData[dwBegin - m_dwPos], dwEnd - dwBegin);
+
+    if (m_bFile) m_File.Update(pData, dwSize);
+
+    m_dwPos += dwSize;
+    x_dwSize -= dwSize;
+
+    if (x_pData != 0) x_pData += dwSize;
+  }
+}
+
+// place x_dwSize bytes of x_pData at x_dwOffset, replacing whatever earlier extents put there
+void ExportPlan::Add(uint32 x_dwOffset, const void *x_pData, uint32 x_dwSize, const MappedFile *x_File) {
+  if (x_dwSize == 0) return;
+
+  // only data that really lies in the mapping can come from the file
+  if (x_File != nullptr && ((const uint08 *)x_pData < x_File->GetData() ||
+                            (const uint08 *)x_pData + x_dwSize > x_File->GetData() + x_File->GetSize()))
+    x_File = nullptr;
+
+  // laid out in one go once the plan is used, later extents taking precedence
+  m_Extents.push_back({x_dwOffset, (const uint08 *)x_pData, x_dwSize, x_File});
+  m_bFinal = false;
+
+  Extend(x_dwOffset + x_dwSize);
+}
+
+// sort the extents by offset, cutting away whatever a later Add placed over them
+void ExportPlan::Finalize() const {
+  if (m_bFinal) return;
+
+  std::vector<Extent> Extents;
+
+  Extents.reserve(m_Extents.size());
+
+  // ranges already claimed by later extents (start -> end), never overlapping or touching
+  std::map<uint32, uint32> Taken;
+
+  for (size_t v = m_Extents.size(); v-- > 0;) {
+    const Extent &e = m_Extents[v];
+
+    uint32 dwEnd = e.dwOffset + e.dwSize;
+
+    // keep the parts no later extent covers
+    {
+      uint32 dwPos = e.dwOffset;
+
+      auto t = Taken.upper_bound(dwPos);
+
+      if (t != Taken.begin() && std::prev(t)->second > dwPos) --t;
+
+      while (dwPos < dwEnd) {
+        uint32 dwNext = (t != Taken.end() && t->first < dwEnd) ? t->first : dwEnd;
+
+        if (dwNext > dwPos) Extents.push_back({dwPos, e.pData + (dwPos - e.dwOffset), dwNext - dwPos, e.pFile});
+
+        if (dwNext == dwEnd) break;
+
+        dwPos = t->second;
+        ++t;
+      }
+    }
+
+    // and claim its range from earlier ones
+    {
+      uint32 dwBegin = e.dwOffset;
+
+      auto t = Taken.upper_bound(dwBegin);
+
+      if (t != Taken.begin() && std::prev(t)->second >= dwBegin) --t;
+
+      while (t != Taken.end() && t->first <= dwEnd) {
+        dwBegin = std::min(dwBegin, t->first);
+        dwEnd = std::max(dwEnd, t->second);
+        t = Taken.erase(t);
+      }
+
+      Taken[dwBegin] = dwEnd;
+    }
+  }
+
+  std::sort(Extents.begin(), Extents.end(),
+            [](const Extent &x_A, const Extent &x_B) { return x_A.dwOffset < x_B.dwOffset; });
+
+  m_Extents.swap(Extents);
+  m_bFinal = true;
+}
+
+// grow the file to at least x_dwSize bytes (anything not covered by an extent reads as zeros)
+void ExportPlan::Extend(uint32 x_dwSize) {
+  if (x_dwSize > m_dwSize) m_dwSize = x_dwSize;
+}
+
+// write the file with positioned, vectored writes (gaps become holes), returns false on error
+bool ExportPlan::Write(int x_fd) const {
+  Finalize();
+
+  std::vector<struct iovec> iov;
+
+  bool bCopy = true;
+
+  size_t e = 0;
+
+  while (e < m_Extents.size()) {
+    if (m_Extents[e].pFile != nullptr) {
+      if (!WriteMapped(x_fd, m_Extents[e], bCopy)) return false;
+
+      // copied or not, the bytes are in the mapping
+      if (m_Digest != nullptr) m_Digest->Update(m_Extents[e].dwOffset, m_Extents[e].pData, m_Extents[e].dwSize);
+
+      e++;
+      continue;
+    }
+
+    // gather a run of back to back extents
+    uint32 dwOffset = m_Extents[e].dwOffset;
+    uint32 dwEnd = dwOffset;
+
+    iov.clear();
+
+    while (e < m_Extents.size() && m_Extents[e].pFile == nullptr && m_Extents[e].dwOffset == dwEnd &&
+           iov.size() < IOV_MAX) {
+      iov.push_back({(void *)m_Extents[e].pData, m_Extents[e].dwSize});
+      dwEnd += m_Extents[e].dwSize;
+      e++;
+    }
+
+    // digested before writing, as short writes move the iovec array along
+    if (m_Digest != nullptr) {
+      uint32 dwPos = dwOffset;
+
+      for (const struct iovec &v : iov) {
+        m_Digest->Update(dwPos, (const uint08 *)v.iov_base, (uint32)v.iov_len);
+        dwPos += (uint32)v.iov_len;
+      }
+    }
+
+    if (!WriteFully(x_fd, iov.data(), (int)iov.size(), dwOffset)) return false;
+  }
+
+  if (m_Digest != nullptr) m_Digest->Final(m_dwSize);
+
+  // set the final size, any zero tail becomes a hole as well (devices such as /dev/null have no size to set)
+  struct stat st;
+
+  if (fstat(x_fd, &st) != 0) return false;
+
+  return !S_ISREG(st.st_mode) || ftruncate(x_fd, m_dwSize) == 0;
+}
+
+// write an extent that lies in a mapped file: runs of pages that are still as they are in the file are copied
+// from there, only modified pages (such as relocated ones) are written from memory
+bool ExportPlan::WriteMapped(int x_fd, const Extent &x_Extent, bool &x_bCopy) {
+  uint32 dwSource = (uint32)(x_Extent.pData - x_Extent.pFile->GetData());
+  uint32 dwDone = 0;
+
+  while (dwDone < x_Extent.dwSize) {
+    bool bModified = true;
+    uint32 dwRun = x_Extent.dwSize - dwDone;
+
+    if (x_bCopy) dwRun = x_Extent.pFile->GetRun(dwSource + dwDone, dwRun, bModified);
+
+    if (!bModified && !CopyRange(x_Extent.pFile->GetFd(), dwSource + dwDone, x_fd, x_Extent.dwOffset + dwDone, dwRun)) {
+      // not supported between these files, so don't try again (anything already copied is simply written over)
+      x_bCopy = false;
+      bModified = true;
+    }
+
+    if (bModified) {
+      struct iovec iov = {(void *)(x_Extent.pData + dwDone), dwRun};
+
+      if (!WriteFully(x_fd, &iov, 1, x_Extent.dwOffset + dwDone)) return false;
+    }
+
+    dwDone += dwRun;
+  }
+
+  return true;
+}
+
+// write the file into a memory buffer (replacing its contents)
+void ExportPlan::Write(std::vector<uint08> &x_Buffer) const {
+  Finalize();
+
+  x_Buffer.assign(m_dwSize, 0);
+
+  for (const Extent &e : m_Extents) {
+    memcpy(&x_Buffer[e.dwOffset], e.pData, e.dwSize);
+
+    if (m_Digest != nullptr) m_Digest->Update(e.dwOffset, e.pData, e.dwSize);
+  }
+
+  if (m_Digest != nullptr) m_Digest->Final(m_dwSize);
+}
+
+// write the file strictly front to back (gaps are written out as zeros), returns false on error
+bool ExportPlan::Stream(int x_fd) const {
+  static const uint08 Zeros[0x1000] = {0};
+
+  Finalize();
+
+  std::vector<struct iovec> iov;
+
+  uint32 dwPos = 0;
+
+  size_t e = 0;
+
+  while (dwPos < m_dwSize) {
+    uint32 dwBatch = dwPos;
+
+    iov.clear();
+
+    while (dwPos < m_dwSize && iov.size() < IOV_MAX) {
+      if (e < m_Extents.size() && m_Extents[e].dwOffset == dwPos) {
+        iov.push_back({(void *)m_Extents[e].pData, m_Extents[e].dwSize});
+        dwPos += m_Extents[e].dwSize;
+        e++;
+        continue;
+      }
+
+      // fill up to the next extent (or the end of the file) from the zero page
+      uint32 dwNext = e < m_Extents.size() ? m_Extents[e].dwOffset : m_dwSize;
+      uint32 dwFill = dwNext - dwPos < sizeof(Zeros) ? dwNext - dwPos : sizeof(Zeros);
+
+      iov.push_back({(void *)Zeros, dwFill});
+      dwPos += dwFill;
+    }
+
+    // digested before writing, as short writes move the iovec array along
+    if (m_Digest != nullptr)
+      for (const struct iovec &v : iov) {
+        m_Digest->Update(dwBatch, (const uint08 *)v.iov_base, (uint32)v.iov_len);
+        dwBatch += (uint32)v.iov_len;
+      }
+
+    if (!WriteFully(x_fd, iov.data(), (int)iov.size(), -1)) return false;
+  }
+
+  if (m_Digest != nullptr) m_Digest->Final(m_dwSize);
+
+  return true;
+}
@@ -0,0 +1,115 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef EXPORTPLAN_H
+#define EXPORTPLAN_H
+
+#include <vector>
+
+#include "Cxbx.h"
+#include "Sha1.h"
+
+class MappedFile;
+
+// SHA-1 digests of an exported file, taken from its bytes as they are written out (so that nothing has to
+// read the file back afterwards)
+class ExportDigest {
+ public:
+  // digest the whole file too, not just its header range, if x_bFile is set
+  explicit ExportDigest(bool x_bFile = false) : m_bFile(x_bFile) {}
+
+  // digest [x_dwBegin, x_dwEnd) of the file as its header, prefixed by the length of the range the way
+  // Xbe digests are taken (call before anything is written)
+  void SetHeader(uint32 x_dwBegin, uint32 x_dwEnd);
+
+  // x_dwSize bytes written at x_dwOffset, which lies at or past everything given so far (whatever was
+  // skipped reads as zeros, x_pData may be 0 for zeros)
+  void Update(uint32 x_dwOffset, const uint08 *x_pData, uint32 x_dwSize);
+
+  // the file is complete at x_dwSize bytes, the digests are final
+  void Final(uint32 x_dwSize);
+
+  // digest of the header range
+  const uint08 *GetHeader() const { return m_HeaderDigest; }
+
+  // digest of the whole file (0 if it was not asked for)
+  const uint08 *GetFile() const { return m_bFile ? m_FileDigest : 0; }
+
+ private:
+  // the next x_dwSize bytes of the file (0 for zeros)
+  void Feed(const uint08 *x_pData, uint32 x_dwSize);
+
+  bool m_bFile;
+
+  uint32 m_dwHeaderBegin{0};
+  uint32 m_dwHeaderEnd{0};
+
+  // bytes of the file digested so far
+  uint32 m_dwPos{0};
+
+  Sha1 m_Header;
+  Sha1 m_File;
+
+  uint08 m_HeaderDigest[SHA1_DIGEST_SIZE]{};
+  uint08 m_FileDigest[SHA1_DIGEST_SIZE]{};
+};
+
+// complete layout of an output file as (offset, buffer, length) extents, built up
+// front so that the file can then be emitted front to back in a single pass
+class ExportPlan {
+ public:
+  // place x_dwSize bytes of x_pData at x_dwOffset, replacing whatever earlier extents put there; if x_pData
+  // lies in x_File's mapping, Write copies what is unmodified straight from the file
+  void Add(uint32 x_dwOffset, const void *x_pData, uint32 x_dwSize, const MappedFile *x_File = nullptr);
+
+  // grow the file to at least x_dwSize bytes (anything not covered by an extent reads as zeros)
+  void Extend(uint32 x_dwSize);
+
+  // total size of the file
+  uint32 GetSize() const { return m_dwSize; }
+
+  // number of extents in the plan
+  uint32 GetExtents() const {
+    Finalize();
+    return (uint32)m_Extents.size();
+  }
+
+  // have every way of writing the file feed x_Digest its bytes in file order, and finalize it at the end
+  void SetDigest(ExportDigest *x_Digest) { m_Digest = x_Digest; }
+
+  // write the file with positioned, vectored writes (gaps become holes) and copy_file_range for extents
+  // still as they are in their mapped file, returns false on error
+  bool Write(int x_fd) const;
+
+  // write the file strictly front to back (gaps are written out as zeros), for pipes and other
+  // non-seekable outputs, returns false on error
+  bool Stream(int x_fd) const;
+
+  // write the file into a memory buffer (replacing its contents)
+  void Write(std::vector<uint08> &x_Buffer) const;
+
+ private:
+  struct Extent {
+    uint32 dwOffset;      // offset into the file
+    const uint08 *pData;  // bytes to write
+    uint32 dwSize;        // number of bytes
+
+    const MappedFile *pFile;  // mapping pData lies in (if any)
+  };
+
+  // sort the extents and cut away what later ones cover (done once, when the plan is first used)
+  void Finalize() const;
+
+  // write an extent that lies in a mapped file, returns false on error (x_bCopy is cleared once the
+  // kernel turns out not to copy between these files)
+  static bool WriteMapped(int x_fd, const Extent &x_Extent, bool &x_bCopy);
+
+  // in the order they were added until finalized, then sorted by offset and never overlapping
+  mutable std::vector<Extent> m_Extents;
+  mutable bool m_bFinal{true};
+
+  uint32 m_dwSize{0};
+
+  ExportDigest *m_Digest{nullptr};
+};
+
+#endif
@@ -0,0 +1,117 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "ImportDirectory.h"
+
+#include <stdio.h>
+#include <strings.h>
+
+#include "Exe.h"
+
+// longest library or function name accepted (anything longer is taken for a corrupt directory)
+#define IMPORT_NAME_MAX 0x400
+
+// thunks imported by ordinal have the top bit set, the others hold the RVA of a hint/name entry
+#define IMPORT_ORDINAL_FLAG 0x80000000
+
+// walk the import directory of an Exe
+ImportDirectory::ImportDirectory(Exe *x_Exe) {
+  char szBuffer[255];
+
+  uint32 dwDirectory = x_Exe->m_OptionalHeader.m_image_data_directory[IMAGE_DIRECTORY_ENTRY_IMPORT].m_virtual_addr;
+
+  if (dwDirectory == 0) return;
+
+  // IMAGE_IMPORT_DESCRIPTOR, the list ends with an all zero descriptor
+  struct Descriptor {
+    uint32 dwLookupRVA;  // import lookup table (OriginalFirstThunk, 0 if only the address table is there)
+    uint32 dwTimeDate;
+    uint32 dwForwarderChain;
+    uint32 dwNameRVA;
+    uint32 dwThunkRVA;  // import address table (FirstThunk)
+  } Desc;
+
+  for (uint32 d = 0;; d++) {
+    if (!x_Exe->Read(dwDirectory + d * sizeof(Desc), &Desc, sizeof(Desc))) {
+      sprintf(szBuffer, "Could not read import descriptor %d (%Xh)", d, d);
+      SetError(szBuffer, true);
+      return;
+    }
+
+    if (Desc.dwNameRVA == 0 && Desc.dwThunkRVA == 0) break;
+
+    Library Lib;
+
+    Lib.dwThunkRVA = Desc.dwThunkRVA;
+
+    if (!ReadString(x_Exe, Desc.dwNameRVA, Lib.Name)) {
+      sprintf(szBuffer, "Could not read name of import descriptor %d (%Xh)", d, d);
+      SetError(szBuffer, true);
+      return;
+    }
+
+    // the lookup table still names every import after binding, the address table only before
+    uint32 dwLookup = Desc.dwLookupRVA != 0 ? Desc.dwLookupRVA : Desc.dwThunkRVA;
+
+    for (uint32 t = 0;; t++) {
+      uint32 dwThunk;
+
+      if (!x_Exe->Read(dwLookup + t * 4, &dwThunk, 4)) {
+        sprintf(szBuffer, "Could not read import %d of %.64s", t, Lib.Name.c_str());
+        SetError(szBuffer, true);
+        return;
+      }
+
+      if (dwThunk == 0) break;
+
+      Import Imp{};
+
+      Imp.dwThunkRVA = Desc.dwThunkRVA + t * 4;
+
+      if (dwThunk & IMPORT_ORDINAL_FLAG) {
+        Imp.dwOrdinal = dwThunk & 0xFFFF;
+      } else if (!x_Exe->Read(dwThunk, &Imp.wHint, 2) || !ReadString(x_Exe, dwThunk + 2, Imp.Name)) {
+        sprintf(szBuffer, "Could not read name of import %d of %.64s", t, Lib.Name.c_str());
+        SetError(szBuffer, true);
+        return;
+      }
+
+      Lib.Imports.push_back(Imp);
+    }
+
+    m_Libraries.push_back(Lib);
+  }
+}
+
+// the imported library with the given name, compared case insensitively
+const ImportDirectory::Library *ImportDirectory::Find(const char *x_szName) const {
+  for (const Library &Lib : m_Libraries)
+    if (strcasecmp(Lib.Name.c_str(), x_szName) == 0) return &Lib;
+
+  return nullptr;
+}
+
+// total number of imported functions
+uint32 ImportDirectory::GetImports() const {
+  uint32 dwImports = 0;
+
+  for (const Library &Lib : m_Libraries) dwImports += (uint32)Lib.Imports.size();
+
+  return dwImports;
+}
+
+// read a null terminated string at a relative virtual address
+bool ImportDirectory::ReadString(Exe *x_Exe, uint32 x_dwRVA, std::string &x_String) {
+  x_String.clear();
+
+  for (uint32 v = 0; v < IMPORT_NAME_MAX; v++) {
+    char c;
+
+    if (!x_Exe->Read(x_dwRVA + v, &c, 1)) return false;
+
+    if (c == '\0') return true;
+
+    x_String += c;
+  }
+
+  return false;
+}
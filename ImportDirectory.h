@@ -0,0 +1,53 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef IMPORTDIRECTORY_H
+#define IMPORTDIRECTORY_H
+
+#include <string>
+#include <vector>
+
+#include "Cxbx.h"
+#include "Error.h"
+
+// the import directory of a PE image: the libraries it imports from and, for each of them, the
+// functions it imports (by ordinal or by name) and the import address table the loader fills in
+class ImportDirectory : public Error {
+ public:
+  // one imported function
+  struct Import {
+    uint32 dwThunkRVA;  // its slot in the import address table
+    uint32 dwOrdinal;   // ordinal it is imported by (0 if it is imported by name)
+    uint16 wHint;       // export table hint (imports by name only)
+    std::string Name;   // name it is imported by (empty if it is imported by ordinal)
+  };
+
+  // one imported library
+  struct Library {
+    std::string Name;
+    uint32 dwThunkRVA;  // import address table (the descriptor's FirstThunk)
+    std::vector<Import> Imports;
+  };
+
+  // walk the import directory of an Exe, checking that every descriptor, name and thunk lies inside the image
+  explicit ImportDirectory(class Exe *x_Exe);
+
+  ImportDirectory(const ImportDirectory &) = delete;
+  ImportDirectory &operator=(const ImportDirectory &) = delete;
+
+  // libraries in directory order
+  const std::vector<Library> &GetLibraries() const { return m_Libraries; }
+
+  // the imported library with the given name, compared case insensitively (nullptr if there is none)
+  const Library *Find(const char *x_szName) const;
+
+  // total number of imported functions
+  uint32 GetImports() const;
+
+ private:
+  // read a null terminated string at a relative virtual address, returns false if it does not end inside the image
+  static bool ReadString(class Exe *x_Exe, uint32 x_dwRVA, std::string &x_String);
+
+  std::vector<Library> m_Libraries;
+};
+
+#endif
@@ -0,0 +1,37 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "Log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// print to stdout, like the tools always have
+static void StdoutSink(void *, LogLevel, const char *x_szText) { fputs(x_szText, stdout); }
+
+LogLevel g_LogLevel = LL_INFO;
+
+static LogSink g_LogSink = StdoutSink;
+static void *g_pLogContext = nullptr;
+
+// route log output to a sink, or drop it entirely with NULL
+void SetLogSink(LogSink x_Sink, void *x_pContext) {
+  g_LogSink = x_Sink;
+  g_pLogContext = x_pContext;
+}
+
+// set how much is logged at run time
+void SetLogLevel(LogLevel x_Level) { g_LogLevel = x_Level; }
+
+// format a message and hand it to the sink
+void LogWrite(LogLevel x_Level, const char *x_szFormat, ...) {
+  if (g_LogSink == nullptr) return;
+
+  char szBuffer[1024];
+
+  va_list args;
+  va_start(args, x_szFormat);
+  vsnprintf(szBuffer, sizeof(szBuffer), x_szFormat, args);
+  va_end(args);
+
+  g_LogSink(g_pLogContext, x_Level, szBuffer);
+}
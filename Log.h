@@ -0,0 +1,41 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef LOG_H
+#define LOG_H
+
+// how much progress output is produced, each level includes the ones before it
+enum LogLevel {
+  LL_NONE,     // nothing at all
+  LL_ERROR,    // failures only
+  LL_INFO,     // one line per step
+  LL_VERBOSE,  // one line per section, library version, etc.
+};
+
+// highest level compiled in at all, anything above it costs nothing at run time
+// (build with -DLOG_MAX_LEVEL=LL_NONE to strip every message)
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LL_VERBOSE
+#endif
+
+// receives each piece of log output as it is produced (lines may arrive in several pieces)
+typedef void (*LogSink)(void *x_pContext, LogLevel x_Level, const char *x_szText);
+
+// route log output to a sink, or drop it entirely with NULL (the default sink prints to stdout)
+void SetLogSink(LogSink x_Sink, void *x_pContext);
+
+// set how much is logged at run time
+void SetLogLevel(LogLevel x_Level);
+
+// current run time level
+extern LogLevel g_LogLevel;
+
+// format a message and hand it to the sink (use LogPrintf instead, which skips the formatting when disabled)
+void LogWrite(LogLevel x_Level, const char *x_szFormat, ...) __attribute__((format(printf, 2, 3)));
+
+// log a printf style message at the given level
+#define LogPrintf(x_Level, ...) \
+  do { \
+    if ((x_Level) <= LOG_MAX_LEVEL && (x_Level) <= g_LogLevel) LogWrite((x_Level), __VA_ARGS__); \
+  } while (0)
+
+#endif
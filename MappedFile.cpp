@@ -0,0 +1,95 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// pagemap entries looked at per GetRun call, which bounds the work for runs of alternating pages
+#define MAPPEDFILE_PAGEMAP_CHUNK 512
+
+// unmaps the file
+MappedFile::~MappedFile() {
+  if (m_pData != nullptr) munmap(m_pData, m_dwSize);
+
+  if (m_fd >= 0) close(m_fd);
+}
+
+// map the given file (returns false if it could not be mapped)
+bool MappedFile::Open(const char *x_szFilename) {
+  struct stat st;
+
+  // opening a FIFO would wait for (and then lose) data meant for whoever opens it next, so only open regular files
+  if (stat(x_szFilename, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+  int fd = open(x_szFilename, O_RDONLY);
+
+  if (fd < 0) return false;
+
+  // only regular, non-empty files that fit our 32-bit offsets can be mapped
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > 0xFFFFFFFF) {
+    close(fd);
+    return false;
+  }
+
+  // a private writable mapping gives copy-on-write semantics for callers that modify the data
+  void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  m_pData = (uint08 *)data;
+  m_dwSize = (uint32)st.st_size;
+  m_fd = fd;
+
+  return true;
+}
+
+// length of the run of bytes starting at x_dwOffset that are all modified or all unmodified
+uint32 MappedFile::GetRun(uint32 x_dwOffset, uint32 x_dwSize, bool &x_bModified) const {
+  x_bModified = true;
+
+#ifdef __linux__
+  static const uint32 dwPageSize = (uint32)sysconf(_SC_PAGESIZE);
+
+  // writing to a private mapping replaces the page with an anonymous copy, which pagemap tells apart from the file
+  // page (bit 61); pages that are not present (and not swapped out, bit 62) have never been written either
+  const uint64_t PM_PRESENT = 1ULL << 63, PM_SWAP = 1ULL << 62, PM_FILE = 1ULL << 61;
+
+  uint64_t Entries[MAPPEDFILE_PAGEMAP_CHUNK];
+
+  uint32 dwFirst = x_dwOffset / dwPageSize;
+  uint32 dwLast = (x_dwOffset + x_dwSize - 1) / dwPageSize;
+  uint32 dwPages = dwLast - dwFirst + 1 < MAPPEDFILE_PAGEMAP_CHUNK ? dwLast - dwFirst + 1 : MAPPEDFILE_PAGEMAP_CHUNK;
+
+  // opened once for the whole process (and left open), as exports call this for every run of pages
+  static const int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+
+  if (pagemap < 0) return x_dwSize;
+
+  off_t pos = (off_t)(((uintptr_t)m_pData / dwPageSize) + dwFirst) * sizeof(uint64_t);
+  ssize_t read = pread(pagemap, Entries, dwPages * sizeof(uint64_t), pos);
+
+  if (read != (ssize_t)(dwPages * sizeof(uint64_t))) return x_dwSize;
+
+  auto IsModified = [&](uint64_t x_Entry) {
+    return (x_Entry & PM_SWAP) || ((x_Entry & PM_PRESENT) && !(x_Entry & PM_FILE));
+  };
+
+  x_bModified = IsModified(Entries[0]);
+
+  uint32 p = 1;
+
+  while (p < dwPages && IsModified(Entries[p]) == x_bModified) p++;
+
+  uint32 dwEnd = (dwFirst + p) * dwPageSize;
+
+  return dwEnd - x_dwOffset < x_dwSize ? dwEnd - x_dwOffset : x_dwSize;
+#else
+  return x_dwSize;
+#endif
+}
@@ -0,0 +1,49 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "Cxbx.h"
+
+// how a file's contents are brought into memory when it is loaded
+enum LoadMode {
+  LM_COPY,    // read everything into separately allocated buffers
+  LM_MAPPED,  // map the file once and point into the mapping
+  LM_LAZY,    // read only the headers, section bodies are read on first access
+};
+
+// a whole file mapped privately into memory: pages are only read in when
+// touched, and writing to them makes a private copy of just that page
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // unmaps the file
+  ~MappedFile();
+
+  // map the given file (returns false if it could not be mapped)
+  bool Open(const char *x_szFilename);
+
+  // start of the mapping
+  uint08 *GetData() const { return m_pData; }
+
+  // size of the mapping (and of the file)
+  uint32 GetSize() const { return m_dwSize; }
+
+  // the mapped file, kept open so that unmodified ranges can be copied from it directly
+  int GetFd() const { return m_fd; }
+
+  // length of the run of bytes starting at x_dwOffset (at most x_dwSize) that have either all been written to
+  // since mapping (x_bModified) or all still read as the file does; everything counts as modified if that
+  // cannot be told
+  uint32 GetRun(uint32 x_dwOffset, uint32 x_dwSize, bool &x_bModified) const;
+
+ private:
+  uint08 *m_pData{nullptr};
+  uint32 m_dwSize{0};
+  int m_fd{-1};
+};
+
+#endif
@@ -2,14 +2,27 @@
 //
 // See https://xboxdevwiki.net/Xbe
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 
 #include "Common.h"
+#include "KernelExports.h"
+#include "Log.h"
+#include "Sha1.h"
+#include "ThreadPool.h"
 #include "Xbe.h"
 
 static constexpr char kEntryPrefix[] = "    ";
@@ -209,6 +222,25 @@ class SectionFlagsValue : public Value {
   Xbe::SectionHeader::_Flags value_;
 };
 
+class DigestValue : public Value {
+ public:
+  explicit DigestValue(const uint08 *value) : value_(value) {}
+
+ protected:
+  std::ostream &WriteStream(std::ostream &os) const override {
+    char buf[SHA1_DIGEST_SIZE * 2 + 1] = {0};
+    for (auto i = 0; i < SHA1_DIGEST_SIZE; ++i) {
+      snprintf(&buf[i * 2], 3, "%02x", value_[i]);
+    }
+    os << buf;
+
+    return os;
+  }
+
+ private:
+  const uint08 *value_;
+};
+
 class SectionHeaderValue : public Value {
  public:
   explicit SectionHeaderValue(const Xbe::SectionHeader *value) : value_(value) {}
@@ -230,6 +262,7 @@ class SectionHeaderValue : public Value {
     fields.emplace_back("Tail shared reference count address",
                         std::make_shared<DecimalValue>(value_->dwTailSharedRefCountAddr));
     fields.emplace_back("Flags", std::make_shared<SectionFlagsValue>(value_->dwFlags));
+    fields.emplace_back("Digest", std::make_shared<DigestValue>(value_->bzSectionDigest));
 
     int max_length = 0;
     for (auto &entry : fields) {
@@ -258,6 +291,9 @@ static void ExtractXBEHeader(const Xbe::Header &header, std::list<NamedValue> &h
 static void ExtractXBELibraryVersions(Xbe *xbe, std::list<NamedValue> &fields);
 static void ExtractTLSDirectory(Xbe *xbe, std::list<NamedValue> &fields);
 static void ExtractSectionHeaders(Xbe *xbe, std::list<NamedValue> &fields);
+static bool ExtractKernelImports(Xbe *xbe, std::list<NamedValue> &fields);
+static void ShowVerifyUsage(const char *program);
+static int VerifyMain(int argc, char *argv[]);
 
 int main(int argc, char *argv[]) {
   char szErrorMessage[ERROR_LEN + 1] = {0};
@@ -268,17 +304,25 @@ int main(int argc, char *argv[]) {
   const char *program_desc = "XBE information dumper (Version: " VERSION ")";
   Option options[] = {{szXbeFilename, nullptr, "xbefile"}, {nullptr}};
 
+  for (int i = 1; i < argc; ++i) {
+    if (CompareString(argv[i], "-VERIFY")) {
+      return VerifyMain(argc, argv);
+    }
+  }
+
   if (ParseOptions(argv, argc, options, szErrorMessage)) {
     goto cleanup;
   }
 
   if (szXbeFilename[0] == '\0') {
     ShowUsage(program, program_desc, options);
+    ShowVerifyUsage(program);
     return 1;
   }
 
   {
-    Xbe *xbe = new Xbe(szXbeFilename);
+    // only the headers are of interest, sections are read if and when something points into them
+    Xbe *xbe = new Xbe(szXbeFilename, LM_LAZY);
     if (xbe->GetError() != 0) {
       strncpy(szErrorMessage, xbe->GetError(), ERROR_LEN);
       goto cleanup;
@@ -310,12 +354,22 @@ int main(int argc, char *argv[]) {
         PrintInfo("Sections", fields);
       }
     }
+    {
+      std::list<NamedValue> fields;
+      if (!ExtractKernelImports(xbe, fields)) {
+        printf("Kernel imports -> Warning: %s\n", xbe->GetError());
+        xbe->ClearError();
+      } else if (!fields.empty()) {
+        PrintInfo("Kernel imports", fields);
+      }
+    }
   }
 
 cleanup:
 
   if (szErrorMessage[0] != 0) {
     ShowUsage(program, program_desc, options);
+    ShowVerifyUsage(program);
 
     printf("\n");
     printf(" *  Error : %s\n", szErrorMessage);
@@ -452,3 +506,321 @@ static void ExtractSectionHeaders(Xbe *xbe, std::list<NamedValue> &fields) {
     fields.emplace_back(name, std::make_shared<SectionHeaderValue>(entry));
   }
 }
+
+static bool ExtractKernelImports(Xbe *xbe, std::list<NamedValue> &fields) {
+  std::vector<uint32> ordinals;
+  if (!xbe->GetKernelImports(ordinals)) {
+    return false;
+  }
+
+  for (auto ordinal : ordinals) {
+    const char *name = KernelExportName(ordinal);
+    fields.emplace_back(name ? name : "<unknown>", std::make_shared<DecimalValue>(ordinal, DecimalValue::INT));
+  }
+  return true;
+}
+
+static void ShowVerifyUsage(const char *program) {
+  printf(
+      "\n"
+      "Verify : %s -VERIFY [switches] xbefile...\n"
+      "\n"
+      "  Checks every section against the digest in its header, one line per file in the order the files\n"
+      "  are done (-ORDERED keeps the order they are given in, -QUIET only reports files that fail,\n"
+      "  -VERBOSE reports every section)\n",
+      program);
+}
+
+struct VerifyResult {
+  // report lines, once the file is done
+  std::string text;
+  bool done{false};
+};
+
+// a file whose sections are being hashed
+struct VerifyJob {
+  size_t index{0};
+  const char *filename{nullptr};
+  std::unique_ptr<Xbe> xbe;
+
+  // recomputed digest of every section
+  std::vector<uint08> digests;
+  std::vector<Sha1Message> messages;
+
+  // chunks of messages still being hashed, the file is reported once this drops to zero
+  std::atomic<uint32_t> remaining{0};
+};
+
+// messages [begin, end) of a file, hashed side by side by whichever thread takes them
+struct VerifyChunk {
+  VerifyJob *job;
+  uint32_t begin;
+  uint32_t end;
+};
+
+struct VerifyTotals {
+  std::mutex mutex;
+  uint32_t files{0};
+  uint32_t failed{0};
+  uint64_t bytes{0};
+  bool quiet{false};
+  bool verbose{false};
+  bool ordered{false};
+
+  // one per file, in the order given
+  std::vector<VerifyResult> results;
+
+  // first file not printed yet (-ORDERED)
+  size_t next{0};
+
+  // guards everything below
+  std::mutex queue_mutex;
+  std::condition_variable queue_wake;
+
+  // sections of the files opened so far, waiting for a thread
+  std::deque<VerifyChunk> chunks;
+
+  // next file to open (in the order they are opened in), and the number of files being opened right now
+  size_t next_open{0};
+  uint32_t opening{0};
+};
+
+// hand in a finished file's report, which is printed right away or, with -ORDERED, once every file before it
+// has been
+static void ReportFile(VerifyTotals &totals, size_t index, std::string text, bool failed, uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(totals.mutex);
+
+  totals.files++;
+  totals.bytes += bytes;
+  if (failed) {
+    totals.failed++;
+  }
+
+  if (!totals.ordered) {
+    fputs(text.c_str(), stdout);
+    fflush(stdout);
+    return;
+  }
+
+  totals.results[index].text = std::move(text);
+  totals.results[index].done = true;
+
+  while (totals.next < totals.results.size() && totals.results[totals.next].done) {
+    fputs(totals.results[totals.next].text.c_str(), stdout);
+    totals.results[totals.next].text.clear();
+    totals.next++;
+  }
+  fflush(stdout);
+}
+
+// open one file and work out what each of its sections' digest is computed over, returns false (having reported
+// the file) if it cannot be read
+static bool OpenFile(VerifyTotals &totals, VerifyJob &job) {
+  char line[1024];
+
+  job.xbe.reset(new Xbe(job.filename, LM_MAPPED));
+
+  Xbe &xbe = *job.xbe;
+
+  if (xbe.GetError() == 0) job.digests.resize(xbe.m_Header.dwSections * SHA1_DIGEST_SIZE);
+
+  if (xbe.GetError() == 0 && !xbe.GetSectionMessages(job.messages, job.digests.data()) && xbe.GetError() == 0) {
+    snprintf(line, sizeof(line), "%s: ERROR -> Could not read every section\n", job.filename);
+    ReportFile(totals, job.index, line, true, 0);
+    job.xbe.reset();
+    return false;
+  }
+
+  if (xbe.GetError() != 0) {
+    snprintf(line, sizeof(line), "%s: ERROR -> %s\n", job.filename, xbe.GetError());
+    ReportFile(totals, job.index, line, true, 0);
+    job.xbe.reset();
+    return false;
+  }
+
+  // biggest first, so that the lanes hashed side by side run out at about the same time
+  std::sort(job.messages.begin(), job.messages.end(),
+            [](const Sha1Message &a, const Sha1Message &b) { return a.dwSize > b.dwSize; });
+
+  return true;
+}
+
+// compare a file's recomputed digests with its headers, report the outcome and let go of the file
+static void FinishFile(VerifyTotals &totals, VerifyJob &job) {
+  std::string text;
+  char line[1024];
+
+  Xbe &xbe = *job.xbe;
+  uint32_t sections = xbe.m_Header.dwSections;
+  uint64_t bytes = 0;
+
+  // counted apart from the list of names, as a section need not have a name
+  std::vector<uint32_t> failed_sections;
+  uint32_t failed = xbe.CheckSectionDigests(job.digests.data(), failed_sections);
+
+  std::string bad;
+  for (uint32_t i : failed_sections) {
+    bad += bad.empty() ? "" : " ";
+    bad += xbe.GetSectionLabel(i);
+  }
+
+  for (uint32_t i = 0; i < sections; ++i) {
+    bool match = std::find(failed_sections.begin(), failed_sections.end(), i) == failed_sections.end();
+
+    bytes += xbe.m_SectionHeader[i].dwSizeofRaw;
+
+    if (totals.verbose) {
+      snprintf(line, sizeof(line), "%s: %-8s %s\n", job.filename, xbe.GetSectionLabel(i).c_str(),
+               match ? "OK" : "FAILED");
+      text += line;
+    }
+  }
+
+  if (failed != 0) {
+    snprintf(line, sizeof(line), "%s: FAILED (%s)\n", job.filename, bad.c_str());
+    text += line;
+  } else if (!totals.quiet) {
+    snprintf(line, sizeof(line), "%s: OK (%u sections)\n", job.filename, sections);
+    text += line;
+  }
+
+  ReportFile(totals, job.index, std::move(text), failed != 0, bytes);
+
+  job.xbe.reset();
+  job.digests = std::vector<uint08>();
+  job.messages = std::vector<Sha1Message>();
+}
+
+// one thread's share of -VERIFY: hash whatever sections are waiting and open the next file when there are none,
+// so that a file's sections are spread over every thread (a file with one big section included) while reading
+// headers on one thread overlaps hashing on the others
+static void VerifyWorker(VerifyTotals &totals, std::vector<VerifyJob> &jobs) {
+  const uint32_t width = Sha1Width();
+
+  std::unique_lock<std::mutex> lock(totals.queue_mutex);
+
+  while (true) {
+    if (!totals.chunks.empty()) {
+      VerifyChunk chunk = totals.chunks.front();
+      totals.chunks.pop_front();
+      lock.unlock();
+
+      Sha1Many(&chunk.job->messages[chunk.begin], chunk.end - chunk.begin);
+
+      if (chunk.job->remaining.fetch_sub(1) == 1) {
+        FinishFile(totals, *chunk.job);
+      }
+
+      lock.lock();
+      continue;
+    }
+
+    if (totals.next_open < jobs.size()) {
+      VerifyJob &job = jobs[totals.next_open++];
+      totals.opening++;
+      lock.unlock();
+
+      bool opened = OpenFile(totals, job);
+      uint32_t messages = static_cast<uint32_t>(job.messages.size());
+
+      if (opened && messages == 0) {
+        FinishFile(totals, job);
+        opened = false;
+      }
+
+      lock.lock();
+      totals.opening--;
+
+      if (opened) {
+        job.remaining = (messages + width - 1) / width;
+
+        for (uint32_t begin = 0; begin < messages; begin += width) {
+          totals.chunks.push_back({&job, begin, std::min(messages, begin + width)});
+        }
+      }
+
+      // there is more to do, or (once the last file is opened) nothing left to wait for
+      totals.queue_wake.notify_all();
+      continue;
+    }
+
+    // every file is open, but one still being opened may bring more sections
+    if (totals.opening == 0) {
+      break;
+    }
+
+    totals.queue_wake.wait(lock);
+  }
+}
+
+// readxbe -VERIFY: recompute the digest of every section of every file given
+static int VerifyMain(int argc, char *argv[]) {
+  const char *program = argv[0];
+  std::vector<const char *> filenames;
+  VerifyTotals totals;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+
+    if (arg[0] != '-' || arg[1] == '\0') {
+      filenames.push_back(arg);
+    } else if (CompareString(&arg[1], "QUIET")) {
+      totals.quiet = true;
+    } else if (CompareString(&arg[1], "VERBOSE")) {
+      totals.verbose = true;
+    } else if (CompareString(&arg[1], "ORDERED")) {
+      totals.ordered = true;
+    } else if (!CompareString(&arg[1], "VERIFY")) {
+      ShowVerifyUsage(program);
+      printf("\n");
+      printf(" *  Error : Unrecognized command : %s\n", &arg[1]);
+      return 1;
+    }
+  }
+
+  if (filenames.empty()) {
+    ShowVerifyUsage(program);
+    return 1;
+  }
+
+  // the results are the output here, not the progress of reading each file
+  SetLogLevel(LL_NONE);
+
+  auto start = std::chrono::steady_clock::now();
+
+  totals.results.resize(filenames.size());
+
+  // biggest files first, so that no thread is left with a big one at the end
+  std::vector<std::pair<uint64_t, uint32_t>> order(filenames.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    struct stat st;
+    order[i] = {stat(filenames[i], &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0, i};
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+                     return a.first > b.first;
+                   });
+
+  std::vector<VerifyJob> jobs(order.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    jobs[i].index = order[i].second;
+    jobs[i].filename = filenames[order[i].second];
+  }
+
+  // files are only opened when no sections are waiting, so about as many are open at once as there are threads
+  uint32_t threads = ThreadPool::Get().GetThreads();
+  ThreadPool::Get().ParallelFor(threads, 1, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      VerifyWorker(totals, jobs);
+    }
+  });
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double megabytes = totals.bytes / (1024.0 * 1024.0);
+
+  printf("Verified %u files, %u failed, %.1f MB in %.2f seconds (%.1f MB/s, %s on %u threads)\n", totals.files,
+         totals.failed, megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0, Sha1Engine(),
+         ThreadPool::Get().GetThreads());
+
+  return totals.failed != 0 ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "Relocation.h"
+
+#include "Exe.h"
+#include "ThreadPool.h"
+
+// tables with fewer entries than this are applied on the calling thread alone
+#define RELOCATION_PARALLEL_MIN 0x4000
+
+// blocks handed to a thread at a time
+#define RELOCATION_PARALLEL_GRAIN 16
+
+// how far ahead of the fixup being applied its successors are prefetched
+#define RELOCATION_PREFETCH 8
+
+// add the counts of another (part of a) table
+void Relocation::Stats::Add(const Stats &x_Stats) {
+  dwBlocks += x_Stats.dwBlocks;
+  dwHighLow += x_Stats.dwHighLow;
+  dwHigh += x_Stats.dwHigh;
+  dwLow += x_Stats.dwLow;
+  dwHighAdj += x_Stats.dwHighAdj;
+  dwAbsolute += x_Stats.dwAbsolute;
+  dwSkipped += x_Stats.dwSkipped;
+}
+
+// add x_dwDelta to every fixup in the table, finding each block's page through x_Resolve
+void Relocation::Apply(uint32 x_dwDelta, Resolver x_Resolve, void *x_pContext, bool x_bParallel) {
+  m_Stats = Stats();
+  m_dwThreads = 1;
+
+  // find the blocks first: each is a page address and size, followed by 16-bit entries
+  std::vector<Block> Blocks;
+
+  uint32 dwEntries = 0;
+
+  bool bIncreasing = true;
+
+  {
+    uint32 v = 0;
+
+    while (v < m_dwSize && m_dwSize - v >= 8) {
+      uint32 dwPage = *(uint32 *)&m_pTable[v + 0];
+      uint32 dwBlockSize = *(uint32 *)&m_pTable[v + 4];
+
+      // an empty block ends the table
+      if (dwBlockSize < 8) break;
+
+      if (dwBlockSize > m_dwSize - v) dwBlockSize = m_dwSize - v;
+
+      // blocks may only run side by side if no two of them touch the same page
+      if (!Blocks.empty() && dwPage <= Blocks.back().dwPage) bIncreasing = false;
+
+      Blocks.push_back({dwPage, v + 8, (dwBlockSize - 8) / 2});
+
+      dwEntries += (dwBlockSize - 8) / 2;
+
+      v += dwBlockSize;
+    }
+  }
+
+  bool bFailed = false;
+
+  ThreadPool &Pool = ThreadPool::Get();
+
+  if (!x_bParallel || !bIncreasing || dwEntries < RELOCATION_PARALLEL_MIN || Pool.GetThreads() == 1) {
+    for (const Block &b : Blocks) {
+      if (!ApplyBlock(b.dwPage, (const uint16 *)&m_pTable[b.dwOffset], b.dwEntries, x_dwDelta, x_Resolve, m_Rebase,
+                      x_pContext, m_Stats)) {
+        bFailed = true;
+        break;
+      }
+    }
+  } else {
+    // every chunk of blocks counts for itself, the counts are added up in order afterwards
+    std::vector<Stats> ChunkStats((Blocks.size() + RELOCATION_PARALLEL_GRAIN - 1) / RELOCATION_PARALLEL_GRAIN);
+
+    std::atomic<bool> bChunkFailed{false};
+
+    Pool.ParallelFor((uint32)Blocks.size(), RELOCATION_PARALLEL_GRAIN, [&](uint32 begin, uint32 end) {
+      Stats &stats = ChunkStats[begin / RELOCATION_PARALLEL_GRAIN];
+
+      for (uint32 b = begin; b < end; b++) {
+        if (!ApplyBlock(Blocks[b].dwPage, (const uint16 *)&m_pTable[Blocks[b].dwOffset], Blocks[b].dwEntries,
+                        x_dwDelta, x_Resolve, m_Rebase, x_pContext, stats)) {
+          bChunkFailed = true;
+          return;
+        }
+      }
+    });
+
+    for (const Stats &stats : ChunkStats) m_Stats.Add(stats);
+
+    bFailed = bChunkFailed;
+
+    m_dwThreads = Pool.GetThreads();
+  }
+
+  if (bFailed) SetError("Unsupported relocation type", true);
+}
+
+// apply the x_dwEntries entries of the block for page x_dwPage, returns false on an unsupported type
+bool Relocation::ApplyBlock(uint32 x_dwPage, const uint16 *x_pEntries, uint32 x_dwEntries, uint32 x_dwDelta,
+                            Resolver x_Resolve, Rebaser x_Rebase, void *x_pContext, Stats &x_Stats) {
+  // the page is resolved once, and again only for fixups that fall outside of what it resolved to
+  // (when a section starts or ends inside the page)
+  uint32 dwBase = 0;
+  uint32 dwSize = 0;
+  uint08 *pBase = 0;
+
+  x_Stats.dwBlocks++;
+
+  for (uint32 e = 0; e < x_dwEntries; e++) {
+    uint32 type = x_pEntries[e] >> 12;
+    uint32 offs = x_pEntries[e] & 0x0FFF;
+
+    if (type == IMAGE_REL_BASED_ABSOLUTE) {
+      x_Stats.dwAbsolute++;
+      continue;
+    }
+
+    if (type != IMAGE_REL_BASED_HIGHLOW && type != IMAGE_REL_BASED_HIGH && type != IMAGE_REL_BASED_LOW &&
+        type != IMAGE_REL_BASED_HIGHADJ)
+      return false;
+
+    // half an address cannot be rebased on its own
+    if (x_Rebase != 0 && (type == IMAGE_REL_BASED_HIGH || type == IMAGE_REL_BASED_LOW)) return false;
+
+    uint32 width = (type == IMAGE_REL_BASED_HIGHLOW) ? 4 : 2;
+
+    if (offs < dwBase || offs - dwBase + width > dwSize) {
+      Target target = x_Resolve(x_pContext, x_dwPage + offs);
+
+      dwBase = offs;
+      pBase = target.pData;
+      dwSize = target.pData != 0 ? target.dwSize : 0;
+    }
+
+    // HIGHADJ keeps the low half of the original value in the next entry
+    uint16 param = 0;
+
+    if (type == IMAGE_REL_BASED_HIGHADJ) {
+      if (++e >= x_dwEntries) return false;
+
+      param = x_pEntries[e];
+    }
+
+    if (pBase == 0 || offs - dwBase + width > dwSize) {
+      x_Stats.dwSkipped++;
+      continue;
+    }
+
+    uint08 *pFix = pBase + (offs - dwBase);
+
+    // pull in the target of a fixup a few entries ahead (a stray address here does no harm)
+    if (e + RELOCATION_PREFETCH < x_dwEntries)
+      __builtin_prefetch(pBase + ((x_pEntries[e + RELOCATION_PREFETCH] & 0x0FFF) - dwBase), 1);
+
+    switch (type) {
+      case IMAGE_REL_BASED_HIGHLOW:
+        if (x_Rebase != 0)
+          *(uint32 *)pFix = x_Rebase(x_pContext, *(uint32 *)pFix);
+        else
+          *(uint32 *)pFix += x_dwDelta;
+        x_Stats.dwHighLow++;
+        break;
+
+      case IMAGE_REL_BASED_HIGH:
+        *(uint16 *)pFix += (uint16)(x_dwDelta >> 16);
+        x_Stats.dwHigh++;
+        break;
+
+      case IMAGE_REL_BASED_LOW:
+        *(uint16 *)pFix += (uint16)x_dwDelta;
+        x_Stats.dwLow++;
+        break;
+
+      case IMAGE_REL_BASED_HIGHADJ: {
+        uint32 value = ((uint32) * (uint16 *)pFix << 16) + (sint32)(sint16)param;
+
+        value = (x_Rebase != 0) ? x_Rebase(x_pContext, value) : value + x_dwDelta;
+
+        *(uint16 *)pFix = (uint16)((value + 0x8000) >> 16);
+        x_Stats.dwHighAdj++;
+      } break;
+    }
+  }
+
+  return true;
+}
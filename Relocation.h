@@ -0,0 +1,88 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef RELOCATION_H
+#define RELOCATION_H
+
+#include <vector>
+
+#include "Cxbx.h"
+#include "Error.h"
+
+// applies a PE base relocation table to an image that is held as separate section
+// buffers, one IMAGE_BASE_RELOCATION block (4k page) at a time
+class Relocation : public Error {
+ public:
+  // writable bytes at a relative virtual address: pData points at the address itself and
+  // dwSize bytes from there on are in the same buffer (pData is 0 if there are none)
+  struct Target {
+    uint08 *pData;
+    uint32 dwSize;
+  };
+
+  // find the target for a relative virtual address
+  typedef Target (*Resolver)(void *x_pContext, uint32 x_dwRVA);
+
+  // relocated value of a whole address, for images whose sections did not all move by the same delta
+  typedef uint32 (*Rebaser)(void *x_pContext, uint32 x_dwValue);
+
+  // what was done, by relocation type
+  struct Stats {
+    uint32 dwBlocks{0};
+    uint32 dwHighLow{0};
+    uint32 dwHigh{0};
+    uint32 dwLow{0};
+    uint32 dwHighAdj{0};
+    uint32 dwAbsolute{0};  // padding entries
+    uint32 dwSkipped{0};   // fixups outside of every section's raw data
+
+    // every fixup that was asked for (padding aside)
+    uint32 GetFixups() const { return dwHighLow + dwHigh + dwLow + dwHighAdj + dwSkipped; }
+
+    // add the counts of another (part of a) table
+    void Add(const Stats &x_Stats);
+  };
+
+  // relocation table of x_dwSize bytes (it is not copied)
+  Relocation(const uint08 *x_pTable, uint32 x_dwSize) : m_pTable(x_pTable), m_dwSize(x_dwSize) {}
+
+  Relocation(const Relocation &) = delete;
+  Relocation &operator=(const Relocation &) = delete;
+
+  // add x_dwDelta to every fixup in the table, finding each block's page through x_Resolve; large tables
+  // whose blocks cover strictly increasing pages are spread over the thread pool (x_Resolve must then be
+  // safe to call from several threads), which gives exactly the same result as applying them in order
+  void Apply(uint32 x_dwDelta, Resolver x_Resolve, void *x_pContext, bool x_bParallel = true);
+
+  // have Apply relocate every address through x_Rebase (with its context) instead of adding the delta,
+  // HIGH and LOW fixups only hold half an address and are then refused as unsupported
+  void SetRebaser(Rebaser x_Rebase) { m_Rebase = x_Rebase; }
+
+  // counts from the last Apply
+  const Stats &GetStats() const { return m_Stats; }
+
+  // number of threads the last Apply used
+  uint32 GetThreads() const { return m_dwThreads; }
+
+ private:
+  // where a block is in the table
+  struct Block {
+    uint32 dwPage;
+    uint32 dwOffset;   // of its first entry
+    uint32 dwEntries;
+  };
+
+  // apply the x_dwEntries entries of the block for page x_dwPage, returns false on an unsupported type
+  static bool ApplyBlock(uint32 x_dwPage, const uint16 *x_pEntries, uint32 x_dwEntries, uint32 x_dwDelta,
+                         Resolver x_Resolve, Rebaser x_Rebase, void *x_pContext, Stats &x_Stats);
+
+  const uint08 *m_pTable;
+  uint32 m_dwSize;
+
+  Rebaser m_Rebase{0};
+
+  Stats m_Stats;
+
+  uint32 m_dwThreads{1};
+};
+
+#endif
@@ -0,0 +1,81 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "SectionIndex.h"
+
+#include <algorithm>
+
+// forget all sections
+void SectionIndex::Clear() {
+  m_Ranges.clear();
+  m_dwLast = 0;
+  m_bBuilt = false;
+}
+
+// add a section covering [x_dwAddr, x_dwAddr + x_dwSize), empty sections are ignored
+void SectionIndex::Add(uint32 x_dwSection, uint32 x_dwAddr, uint32 x_dwSize) {
+  m_bBuilt = false;
+
+  if (x_dwSize != 0) m_Ranges.push_back({x_dwAddr, x_dwSize, x_dwSection});
+}
+
+// sort the ranges, returns false (and stays unusable) if any of them overlap
+bool SectionIndex::Build() {
+  std::sort(m_Ranges.begin(), m_Ranges.end(), [](const Range &a, const Range &b) { return a.dwAddr < b.dwAddr; });
+
+  m_dwLast = 0;
+
+  // with overlapping sections the first one in header order wins, which a sorted search can not promise
+  for (size_t v = 1; v < m_Ranges.size(); v++) {
+    if (m_Ranges[v].dwAddr - m_Ranges[v - 1].dwAddr < m_Ranges[v - 1].dwSize) {
+      m_bBuilt = false;
+      return false;
+    }
+  }
+
+  m_bBuilt = true;
+
+  return true;
+}
+
+// binary search, remembering the hit
+sint32 SectionIndex::FindSlow(uint32 x_dwAddr) const {
+  // first range starting above the address, the candidate is the one before it
+  auto it = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), x_dwAddr,
+                             [](uint32 dwAddr, const Range &r) { return dwAddr < r.dwAddr; });
+
+  if (it == m_Ranges.begin()) return -1;
+
+  --it;
+
+  if (x_dwAddr - it->dwAddr >= it->dwSize) return -1;
+
+  m_dwLast.store((uint32)(it - m_Ranges.begin()), std::memory_order_relaxed);
+
+  return it->dwSection;
+}
+
+// find the sections of x_dwCount addresses in one merged pass over the ranges
+void SectionIndex::FindSorted(const uint32 *x_dwAddrs, sint32 *x_Sections, uint32 x_dwCount) const {
+  size_t r = 0;
+
+  for (uint32 v = 0; v < x_dwCount; v++) {
+    uint32 dwAddr = x_dwAddrs[v];
+
+    // out of order, search for the range again
+    if (r < m_Ranges.size() && dwAddr < m_Ranges[r].dwAddr) {
+      r = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), dwAddr,
+                           [](uint32 dwAddr, const Range &r) { return dwAddr < r.dwAddr; }) -
+          m_Ranges.begin();
+
+      if (r != 0) r--;
+    }
+
+    // move on to the last range starting at or below the address
+    while (r + 1 < m_Ranges.size() && m_Ranges[r + 1].dwAddr <= dwAddr) r++;
+
+    if (r < m_Ranges.size() && dwAddr - m_Ranges[r].dwAddr < m_Ranges[r].dwSize)
+      x_Sections[v] = m_Ranges[r].dwSection;
+    else
+      x_Sections[v] = -1;
+  }
+}
@@ -0,0 +1,61 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef SECTIONINDEX_H
+#define SECTIONINDEX_H
+
+#include <atomic>
+#include <vector>
+
+#include "Cxbx.h"
+
+// address ranges of an image's sections, sorted so that the section holding an
+// address can be found by binary search (and without searching at all when the
+// address falls into the same section as the previous lookup)
+class SectionIndex {
+ public:
+  // forget all sections
+  void Clear();
+
+  // add a section covering [x_dwAddr, x_dwAddr + x_dwSize), empty sections are ignored
+  void Add(uint32 x_dwSection, uint32 x_dwAddr, uint32 x_dwSize);
+
+  // sort the ranges, returns false (and stays unusable) if any of them overlap
+  bool Build();
+
+  // can lookups be answered? (if not, callers fall back to scanning the section headers)
+  bool IsBuilt() const { return m_bBuilt; }
+
+  // section containing x_dwAddr, or -1 if there is none (safe to call from several threads at once)
+  sint32 Find(uint32 x_dwAddr) const {
+    uint32 dwLast = m_dwLast.load(std::memory_order_relaxed);
+
+    if (dwLast < m_Ranges.size() && x_dwAddr - m_Ranges[dwLast].dwAddr < m_Ranges[dwLast].dwSize)
+      return m_Ranges[dwLast].dwSection;
+
+    return FindSlow(x_dwAddr);
+  }
+
+  // find the sections of x_dwCount addresses in one merged pass over the ranges (addresses should be
+  // sorted ascending for this to pay off, anything else still works but searches again), -1 for none
+  void FindSorted(const uint32 *x_dwAddrs, sint32 *x_Sections, uint32 x_dwCount) const;
+
+ private:
+  struct Range {
+    uint32 dwAddr;
+    uint32 dwSize;
+    uint32 dwSection;
+  };
+
+  // binary search, remembering the hit
+  sint32 FindSlow(uint32 x_dwAddr) const;
+
+  // sorted by address
+  std::vector<Range> m_Ranges;
+
+  // position of the most recent hit in m_Ranges (a single word, so that threads sharing it never see it torn)
+  mutable std::atomic<uint32> m_dwLast{0};
+
+  bool m_bBuilt{false};
+};
+
+#endif
@@ -0,0 +1,477 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "Sha1.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA1_X86
+#endif
+
+// most messages the lanes hold at once (eight 32-bit lanes in an AVX2 register)
+#define SHA1_LANES 8
+
+// round constants
+#define SHA1_K0 0x5A827999
+#define SHA1_K1 0x6ED9EBA1
+#define SHA1_K2 0x8F1BBCDC
+#define SHA1_K3 0xCA62C1D6
+
+// what Sha1 and Sha1Many run on
+enum Sha1Impl { SI_SCALAR, SI_SSE2, SI_AVX2, SI_SHA };
+
+// hash x_Blocks whole blocks of a single message
+typedef void (*Sha1Blocks)(uint32 x_State[5], const uint08 *x_pData, size_t x_Blocks);
+
+// hash one block of every lane's message (x_State is word major, lane minor)
+typedef void (*Sha1LaneBlocks)(uint32 x_State[5][SHA1_LANES], const uint08 *const x_Blocks[SHA1_LANES]);
+
+static const uint32 Sha1Init[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+static inline uint32 Rol(uint32 x_dwValue, uint32 x_dwBits) {
+  return (x_dwValue << x_dwBits) | (x_dwValue >> (32 - x_dwBits));
+}
+
+// big endian digest from a state
+static void StoreDigest(uint08 *x_pDigest, const uint32 x_State[5]) {
+  for (uint32 v = 0; v < 5; v++) {
+    uint32 w = __builtin_bswap32(x_State[v]);
+
+    memcpy(&x_pDigest[v * 4], &w, 4);
+  }
+}
+
+// one block at a time, a word at a time
+static void Sha1BlocksScalar(uint32 x_State[5], const uint08 *x_pData, size_t x_Blocks) {
+  for (; x_Blocks > 0; x_Blocks--, x_pData += 64) {
+    uint32 W[16];
+
+    for (uint32 t = 0; t < 16; t++) {
+      uint32 w;
+
+      memcpy(&w, &x_pData[t * 4], 4);
+
+      W[t] = __builtin_bswap32(w);
+    }
+
+    uint32 a = x_State[0], b = x_State[1], c = x_State[2], d = x_State[3], e = x_State[4];
+
+    for (uint32 t = 0; t < 80; t++) {
+      if (t >= 16) W[t & 15] = Rol(W[(t - 3) & 15] ^ W[(t - 8) & 15] ^ W[(t - 14) & 15] ^ W[t & 15], 1);
+
+      uint32 f;
+
+      if (t < 20)
+        f = ((b & c) | (~b & d)) + SHA1_K0;
+      else if (t < 40)
+        f = (b ^ c ^ d) + SHA1_K1;
+      else if (t < 60)
+        f = ((b & c) | (b & d) | (c & d)) + SHA1_K2;
+      else
+        f = (b ^ c ^ d) + SHA1_K3;
+
+      uint32 tmp = Rol(a, 5) + f + e + W[t & 15];
+
+      e = d;
+      d = c;
+      c = Rol(b, 30);
+      b = a;
+      a = tmp;
+    }
+
+    x_State[0] += a;
+    x_State[1] += b;
+    x_State[2] += c;
+    x_State[3] += d;
+    x_State[4] += e;
+  }
+}
+
+#ifdef SHA1_X86
+typedef uint32 Sha1V4 __attribute__((vector_size(16)));
+typedef uint32 Sha1V8 __attribute__((vector_size(32)));
+
+// one block of each of LANES messages, every vector element being one message's word (inlined into the
+// wrappers below, which decide what instructions it is compiled to)
+template <typename V, uint32 LANES>
+static inline __attribute__((always_inline)) void Sha1LaneBlock(uint32 x_State[5][SHA1_LANES],
+                                                                const uint08 *const x_Blocks[SHA1_LANES]) {
+  V W[16];
+
+  for (uint32 t = 0; t < 16; t++) {
+    for (uint32 l = 0; l < LANES; l++) {
+      uint32 w;
+
+      memcpy(&w, &x_Blocks[l][t * 4], 4);
+
+      W[t][l] = __builtin_bswap32(w);
+    }
+  }
+
+  V a, b, c, d, e;
+
+  memcpy(&a, x_State[0], sizeof(V));
+  memcpy(&b, x_State[1], sizeof(V));
+  memcpy(&c, x_State[2], sizeof(V));
+  memcpy(&d, x_State[3], sizeof(V));
+  memcpy(&e, x_State[4], sizeof(V));
+
+  V a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+
+  for (uint32 t = 0; t < 80; t++) {
+    if (t >= 16) {
+      V x = W[(t - 3) & 15] ^ W[(t - 8) & 15] ^ W[(t - 14) & 15] ^ W[t & 15];
+
+      W[t & 15] = (x << 1) | (x >> 31);
+    }
+
+    V f;
+
+    if (t < 20)
+      f = ((b & c) | (~b & d)) + SHA1_K0;
+    else if (t < 40)
+      f = (b ^ c ^ d) + SHA1_K1;
+    else if (t < 60)
+      f = ((b & c) | (b & d) | (c & d)) + SHA1_K2;
+    else
+      f = (b ^ c ^ d) + SHA1_K3;
+
+    V tmp = ((a << 5) | (a >> 27)) + f + e + W[t & 15];
+
+    e = d;
+    d = c;
+    c = (b << 30) | (b >> 2);
+    b = a;
+    a = tmp;
+  }
+
+  a += a0;
+  b += b0;
+  c += c0;
+  d += d0;
+  e += e0;
+
+  memcpy(x_State[0], &a, sizeof(V));
+  memcpy(x_State[1], &b, sizeof(V));
+  memcpy(x_State[2], &c, sizeof(V));
+  memcpy(x_State[3], &d, sizeof(V));
+  memcpy(x_State[4], &e, sizeof(V));
+}
+
+// four messages at a time
+__attribute__((target("sse2"))) static void Sha1LanesSSE2(uint32 x_State[5][SHA1_LANES],
+                                                          const uint08 *const x_Blocks[SHA1_LANES]) {
+  Sha1LaneBlock<Sha1V4, 4>(x_State, x_Blocks);
+}
+
+// eight messages at a time
+__attribute__((target("avx2"))) static void Sha1LanesAVX2(uint32 x_State[5][SHA1_LANES],
+                                                          const uint08 *const x_Blocks[SHA1_LANES]) {
+  Sha1LaneBlock<Sha1V8, 8>(x_State, x_Blocks);
+}
+
+// one message with the SHA instructions, four rounds per instruction
+__attribute__((target("sha,sse4.1"))) static void Sha1BlocksSHA(uint32 x_State[5], const uint08 *x_pData,
+                                                                 size_t x_Blocks) {
+  const __m128i Swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+
+  __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)x_State), 0x1B);
+  __m128i E0 = _mm_set_epi32((int)x_State[4], 0, 0, 0);
+  __m128i E1;
+
+  for (; x_Blocks > 0; x_Blocks--, x_pData += 64) {
+    __m128i ABCD_Save = ABCD;
+    __m128i E0_Save = E0;
+
+    __m128i Msg[4];
+
+    // twenty groups of four rounds, each also working the message schedule a few groups ahead
+    for (uint32 g = 0; g < 20; g++) {
+      __m128i &Cur = Msg[g % 4];
+
+      if (g < 4) Cur = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&x_pData[g * 16]), Swap);
+
+      __m128i &E = (g % 2 == 0) ? E0 : E1;
+
+      if (g == 0)
+        E0 = _mm_add_epi32(E0, Cur);
+      else
+        E = _mm_sha1nexte_epu32(E, Cur);
+
+      ((g % 2 == 0) ? E1 : E0) = ABCD;
+
+      switch (g / 5) {
+        case 0: ABCD = _mm_sha1rnds4_epu32(ABCD, E, 0); break;
+        case 1: ABCD = _mm_sha1rnds4_epu32(ABCD, E, 1); break;
+        case 2: ABCD = _mm_sha1rnds4_epu32(ABCD, E, 2); break;
+        default: ABCD = _mm_sha1rnds4_epu32(ABCD, E, 3); break;
+      }
+
+      if (g >= 3 && g <= 18) Msg[(g + 1) % 4] = _mm_sha1msg2_epu32(Msg[(g + 1) % 4], Cur);
+      if (g >= 1 && g <= 16) Msg[(g + 3) % 4] = _mm_sha1msg1_epu32(Msg[(g + 3) % 4], Cur);
+      if (g >= 2 && g <= 17) Msg[(g + 2) % 4] = _mm_xor_si128(Msg[(g + 2) % 4], Cur);
+    }
+
+    E0 = _mm_sha1nexte_epu32(E0, E0_Save);
+    ABCD = _mm_add_epi32(ABCD, ABCD_Save);
+  }
+
+  _mm_storeu_si128((__m128i *)x_State, _mm_shuffle_epi32(ABCD, 0x1B));
+
+  x_State[4] = (uint32)_mm_extract_epi32(E0, 3);
+}
+
+// does the processor have the SHA instructions (and the SSE4.1 that goes with them)?
+static bool HasSHA() {
+  unsigned int a, b, c, d;
+
+  if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1)) return false;
+
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+
+  return (b & bit_SHA) != 0;
+}
+#endif
+
+// can the processor run x_Impl?
+static bool IsSupported(Sha1Impl x_Impl) {
+  switch (x_Impl) {
+#ifdef SHA1_X86
+    case SI_SHA: return HasSHA();
+    case SI_AVX2: return __builtin_cpu_supports("avx2");
+    case SI_SSE2: return __builtin_cpu_supports("sse2");
+#endif
+    case SI_SCALAR: return true;
+    default: return false;
+  }
+}
+
+// the implementation in use, the best there is on this processor unless Sha1UseEngine said otherwise
+static Sha1Impl &CurrentImpl() {
+  static Sha1Impl Impl = IsSupported(SI_SHA)    ? SI_SHA
+                         : IsSupported(SI_AVX2) ? SI_AVX2
+                         : IsSupported(SI_SSE2) ? SI_SSE2
+                                                : SI_SCALAR;
+
+  return Impl;
+}
+
+static Sha1Impl GetImpl() { return CurrentImpl(); }
+
+// single message implementation
+static Sha1Blocks GetBlocks() {
+#ifdef SHA1_X86
+  if (GetImpl() == SI_SHA) return Sha1BlocksSHA;
+#endif
+
+  return Sha1BlocksScalar;
+}
+
+// what Sha1Engine calls x_Impl
+static const char *ImplName(Sha1Impl x_Impl) {
+  switch (x_Impl) {
+    case SI_SHA: return "SHA Extensions";
+    case SI_AVX2: return "AVX2, 8 Lanes";
+    case SI_SSE2: return "SSE2, 4 Lanes";
+    default: return "Scalar";
+  }
+}
+
+// name of the implementation Sha1Many uses on this processor
+const char *Sha1Engine() { return ImplName(GetImpl()); }
+
+// switch over to the implementation called x_szEngine
+bool Sha1UseEngine(const char *x_szEngine) {
+  static const Sha1Impl Impls[] = {SI_SCALAR, SI_SSE2, SI_AVX2, SI_SHA};
+
+  for (Sha1Impl Impl : Impls) {
+    if (strcmp(ImplName(Impl), x_szEngine) == 0 && IsSupported(Impl)) {
+      CurrentImpl() = Impl;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// number of messages Sha1Many works on at once
+uint32 Sha1Width() {
+  switch (GetImpl()) {
+    case SI_AVX2: return 8;
+    case SI_SSE2: return 4;
+    default: return 1;
+  }
+}
+
+// start over with an empty message
+void Sha1::Reset() {
+  memcpy(m_State, Sha1Init, sizeof(m_State));
+
+  m_qwLength = 0;
+}
+
+// append x_Size bytes to the message
+void Sha1::Update(const void *x_pData, size_t x_Size) {
+  const uint08 *pData = (const uint08 *)x_pData;
+
+  if (x_Size == 0) return;
+
+  size_t dwHave = (size_t)(m_qwLength % 64);
+
+  m_qwLength += x_Size;
+
+  // top up a partial block first
+  if (dwHave != 0) {
+    size_t dwTake = (x_Size < 64 - dwHave) ? x_Size : 64 - dwHave;
+
+    memcpy(&m_Block[dwHave], pData, dwTake);
+
+    pData += dwTake;
+    x_Size -= dwTake;
+
+    if (dwHave + dwTake < 64) return;
+
+    GetBlocks()(m_State, m_Block, 1);
+  }
+
+  // whole blocks straight from the caller's buffer
+  if (x_Size >= 64) {
+    GetBlocks()(m_State, pData, x_Size / 64);
+
+    pData += x_Size & ~(size_t)63;
+    x_Size &= 63;
+  }
+
+  memcpy(m_Block, pData, x_Size);
+}
+
+// pad the message and write out its digest
+void Sha1::Final(uint08 x_Digest[SHA1_DIGEST_SIZE]) {
+  uint64_t qwBits = m_qwLength * 8;
+
+  uint08 Pad[72] = {0x80};
+
+  uint32 dwHave = (uint32)(m_qwLength % 64);
+
+  Update(Pad, (dwHave < 56) ? 56 - dwHave : 120 - dwHave);
+
+  uint08 Length[8];
+
+  for (uint32 v = 0; v < 8; v++) Length[v] = (uint08)(qwBits >> (56 - v * 8));
+
+  Update(Length, 8);
+
+  StoreDigest(x_Digest, m_State);
+}
+
+// number of blocks in a padded message
+static uint32 MessageBlocks(const Sha1Message &x_Msg) {
+  return (uint32)(((uint64_t)x_Msg.dwPrefix + x_Msg.dwSize + 9 + 63) / 64);
+}
+
+// a block of a padded message, in place if it lies wholly in the data, otherwise assembled in x_Buffer
+static const uint08 *MessageBlock(const Sha1Message &x_Msg, uint32 x_dwBlock, uint08 x_Buffer[64]) {
+  uint64_t qwLength = (uint64_t)x_Msg.dwPrefix + x_Msg.dwSize;
+  uint64_t qwOffs = (uint64_t)x_dwBlock * 64;
+
+  if (qwOffs >= x_Msg.dwPrefix && qwOffs + 64 <= qwLength) return &x_Msg.pData[qwOffs - x_Msg.dwPrefix];
+
+  for (uint32 v = 0; v < 64; v++) {
+    uint64_t o = qwOffs + v;
+
+    if (o < x_Msg.dwPrefix)
+      x_Buffer[v] = x_Msg.pPrefix[o];
+    else if (o < qwLength)
+      x_Buffer[v] = x_Msg.pData[o - x_Msg.dwPrefix];
+    else
+      x_Buffer[v] = (o == qwLength) ? 0x80 : 0;
+  }
+
+  // the length in bits ends the last block
+  if (x_dwBlock == MessageBlocks(x_Msg) - 1)
+    for (uint32 v = 0; v < 8; v++) x_Buffer[56 + v] = (uint08)((qwLength * 8) >> (56 - v * 8));
+
+  return x_Buffer;
+}
+
+// keep x_dwLanes messages going side by side, starting the next one in a lane as soon as its message ends
+static void Sha1ManyLanes(const Sha1Message *x_Messages, uint32 x_dwMessages, uint32 x_dwLanes,
+                          Sha1LaneBlocks x_Compress) {
+  static const uint08 Idle[64] = {0};
+
+  uint32 State[5][SHA1_LANES];
+  uint08 Buffer[SHA1_LANES][64];
+  const uint08 *Blocks[SHA1_LANES];
+
+  sint32 Job[SHA1_LANES];
+  uint32 Block[SHA1_LANES];
+  uint32 Count[SHA1_LANES];
+
+  uint32 dwNext = 0;
+  uint32 dwActive = 0;
+
+  auto Start = [&](uint32 l) {
+    Job[l] = -1;
+
+    if (dwNext >= x_dwMessages) return;
+
+    Job[l] = (sint32)dwNext;
+    Block[l] = 0;
+    Count[l] = MessageBlocks(x_Messages[dwNext]);
+
+    for (uint32 w = 0; w < 5; w++) State[w][l] = Sha1Init[w];
+
+    dwNext++;
+    dwActive++;
+  };
+
+  for (uint32 l = 0; l < SHA1_LANES; l++) {
+    Job[l] = -1;
+
+    for (uint32 w = 0; w < 5; w++) State[w][l] = 0;
+  }
+
+  for (uint32 l = 0; l < x_dwLanes; l++) Start(l);
+
+  while (dwActive > 0) {
+    for (uint32 l = 0; l < SHA1_LANES; l++)
+      Blocks[l] = (Job[l] >= 0) ? MessageBlock(x_Messages[Job[l]], Block[l], Buffer[l]) : Idle;
+
+    x_Compress(State, Blocks);
+
+    for (uint32 l = 0; l < x_dwLanes; l++) {
+      if (Job[l] < 0 || ++Block[l] < Count[l]) continue;
+
+      uint32 Digest[5];
+
+      for (uint32 w = 0; w < 5; w++) Digest[w] = State[w][l];
+
+      StoreDigest(x_Messages[Job[l]].pDigest, Digest);
+
+      dwActive--;
+
+      Start(l);
+    }
+  }
+}
+
+// digests of all the messages
+void Sha1Many(const Sha1Message *x_Messages, uint32 x_dwMessages) {
+#ifdef SHA1_X86
+  Sha1Impl Impl = GetImpl();
+
+  if (x_dwMessages > 1 && Impl == SI_AVX2) return Sha1ManyLanes(x_Messages, x_dwMessages, 8, Sha1LanesAVX2);
+
+  if (x_dwMessages > 1 && Impl == SI_SSE2) return Sha1ManyLanes(x_Messages, x_dwMessages, 4, Sha1LanesSSE2);
+#endif
+
+  for (uint32 v = 0; v < x_dwMessages; v++) {
+    Sha1 Hash;
+
+    Hash.Update(x_Messages[v].pPrefix, x_Messages[v].dwPrefix);
+    Hash.Update(x_Messages[v].pData, x_Messages[v].dwSize);
+    Hash.Final(x_Messages[v].pDigest);
+  }
+}
@@ -0,0 +1,62 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+
+#include "Cxbx.h"
+
+// size of a SHA-1 digest
+#define SHA1_DIGEST_SIZE 20
+
+// SHA-1 of a message that is given a piece at a time
+class Sha1 {
+ public:
+  Sha1() { Reset(); }
+
+  // start over with an empty message
+  void Reset();
+
+  // append x_Size bytes to the message
+  void Update(const void *x_pData, size_t x_Size);
+
+  // pad the message and write out its digest (Reset before using this object again)
+  void Final(uint08 x_Digest[SHA1_DIGEST_SIZE]);
+
+ private:
+  uint32 m_State[5];
+
+  // bytes hashed so far, of which the last (m_qwLength % 64) are still in m_Block
+  uint64_t m_qwLength;
+
+  uint08 m_Block[64];
+};
+
+// a message for Sha1Many: a prefix followed by the data (either may be empty)
+struct Sha1Message {
+  const uint08 *pPrefix;
+  uint32 dwPrefix;
+  const uint08 *pData;
+  uint32 dwSize;
+
+  // receives the digest
+  uint08 *pDigest;
+};
+
+// digests of all the messages, hashed side by side in the lanes of the widest vector unit there is (or one
+// after the other if the processor has SHA instructions, which are faster still)
+void Sha1Many(const Sha1Message *x_Messages, uint32 x_dwMessages);
+
+// number of messages Sha1Many works on at once (1 if it hashes them one after the other)
+uint32 Sha1Width();
+
+// name of the implementation Sha1Many uses on this processor
+const char *Sha1Engine();
+
+// make Sha1 and Sha1Many use the implementation Sha1Engine calls x_szEngine from now on, so that the
+// implementations can be tested against each other; returns false if the processor cannot run it (and nothing
+// else may be hashing while this is called)
+bool Sha1UseEngine(const char *x_szEngine);
+
+#endif
@@ -0,0 +1,107 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "ThreadPool.h"
+
+// set on pool threads (and on the caller while it helps out) so that nested loops run inline
+static thread_local bool t_bInLoop = false;
+
+// the process wide pool, started on first use with one thread per core
+ThreadPool &ThreadPool::Get() {
+  static ThreadPool Pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+
+  return Pool;
+}
+
+ThreadPool::ThreadPool(uint32 x_dwWorkers) {
+  for (uint32 v = 0; v < x_dwWorkers; v++) m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+// stops and joins the workers
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_bStop = true;
+  }
+
+  m_Wake.notify_all();
+
+  for (std::thread &t : m_Workers) t.join();
+}
+
+// call x_Func(begin, end) for chunks of at most x_dwGrain items until [0, x_dwCount) is covered
+void ThreadPool::ParallelFor(uint32 x_dwCount, uint32 x_dwGrain, const std::function<void(uint32, uint32)> &x_Func) {
+  if (x_dwCount == 0) return;
+
+  if (x_dwGrain == 0) x_dwGrain = 1;
+
+  // nothing to share
+  if (m_Workers.empty() || x_dwCount <= x_dwGrain || t_bInLoop) {
+    for (uint32 begin = 0; begin < x_dwCount; begin += x_dwGrain)
+      x_Func(begin, x_dwCount - begin < x_dwGrain ? x_dwCount : begin + x_dwGrain);
+    return;
+  }
+
+  std::lock_guard<std::mutex> loop(m_LoopMutex);
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_pFunc = &x_Func;
+    m_dwCount = x_dwCount;
+    m_dwGrain = x_dwGrain;
+    m_qwNext = 0;
+    m_dwBusy = (uint32)m_Workers.size();
+    m_qwGeneration++;
+  }
+
+  m_Wake.notify_all();
+
+  // help out rather than wait
+  t_bInLoop = true;
+  RunChunks();
+  t_bInLoop = false;
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+
+  m_Done.wait(lock, [this] { return m_dwBusy == 0; });
+
+  m_pFunc = nullptr;
+}
+
+// worker thread body
+void ThreadPool::WorkerLoop() {
+  uint64_t qwSeen = 0;
+
+  t_bInLoop = true;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+
+      m_Wake.wait(lock, [&] { return m_bStop || m_qwGeneration != qwSeen; });
+
+      if (m_bStop) return;
+
+      qwSeen = m_qwGeneration;
+    }
+
+    RunChunks();
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+
+      if (--m_dwBusy == 0) m_Done.notify_all();
+    }
+  }
+}
+
+// claim and run chunks of the current loop until there are none left
+void ThreadPool::RunChunks() {
+  uint64_t begin;
+
+  while ((begin = m_qwNext.fetch_add(m_dwGrain)) < m_dwCount) {
+    uint64_t end = begin + m_dwGrain < m_dwCount ? begin + m_dwGrain : m_dwCount;
+
+    (*m_pFunc)((uint32)begin, (uint32)end);
+  }
+}
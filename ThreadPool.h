@@ -0,0 +1,68 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Cxbx.h"
+
+// a fixed set of worker threads that split loops between them (and the calling thread)
+class ThreadPool {
+ public:
+  // the process wide pool, started on first use with one thread per core
+  static ThreadPool &Get();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // stops and joins the workers
+  ~ThreadPool();
+
+  // number of threads a loop is spread over, the calling thread included
+  uint32 GetThreads() const { return (uint32)m_Workers.size() + 1; }
+
+  // call x_Func(begin, end) for chunks of at most x_dwGrain items until [0, x_dwCount) is covered, and
+  // return once all of them are done (loops started from inside a loop simply run on the calling thread)
+  void ParallelFor(uint32 x_dwCount, uint32 x_dwGrain, const std::function<void(uint32, uint32)> &x_Func);
+
+ private:
+  explicit ThreadPool(uint32 x_dwWorkers);
+
+  // worker thread body
+  void WorkerLoop();
+
+  // claim and run chunks of the current loop until there are none left
+  void RunChunks();
+
+  std::vector<std::thread> m_Workers;
+
+  // one loop at a time
+  std::mutex m_LoopMutex;
+
+  // guards everything below
+  std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  std::condition_variable m_Done;
+
+  // current loop
+  const std::function<void(uint32, uint32)> *m_pFunc{nullptr};
+  uint32 m_dwCount{0};
+  uint32 m_dwGrain{1};
+  std::atomic<uint64_t> m_qwNext{0};
+
+  // workers still busy with the current loop
+  uint32 m_dwBusy{0};
+
+  // bumped for every loop, so that workers can tell a new one has started
+  uint64_t m_qwGeneration{0};
+
+  bool m_bStop{false};
+};
+
+#endif
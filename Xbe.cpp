@@ -33,24 +33,57 @@
 // ******************************************************************
 #include "Xbe.h"
 
+#include "Common.h"
 #include "Exe.h"
+#include "ExportPlan.h"
+#include "ImportDirectory.h"
+#include "KernelExports.h"
+#include "Log.h"
+#include "Sha1.h"
+#include "ThreadPool.h"
+#include "ZeroScan.h"
 // #include "Emu.h"
 
+#include <ctype.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <memory.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <map>
 
 // construct via Xbe file
-Xbe::Xbe(const char *x_szFilename) {
+Xbe::Xbe(const char *x_szFilename, LoadMode x_Mode) {
   char szBuffer[260];
 
   ConstructorInit();
 
-  printf("Xbe::Xbe: Opening Xbe file...");
+  // map the whole file once and parse it in place
+  if (x_Mode == LM_MAPPED) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Mapping Xbe file...");
+
+    std::shared_ptr<MappedFile> File = std::make_shared<MappedFile>();
+
+    if (File->Open(x_szFilename)) {
+      LogPrintf(LL_INFO, "OK\n");
+
+      m_File = File;
+
+      ParseImage(File->GetData(), File->GetSize());
+
+      return;
+    }
+
+    // not a regular file (or mmap is unavailable), fall back to reading it
+    LogPrintf(LL_INFO, "Unavailable, reading instead\n");
+  }
+
+  LogPrintf(LL_INFO, "Xbe::Xbe: Opening Xbe file...");
 
   FILE *XbeFile = fopen(x_szFilename, "rb");
 
@@ -60,11 +93,35 @@ Xbe::Xbe(const char *x_szFilename) {
     goto cleanup;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
+
+  // a pipe cannot seek to what the headers point at, so read it whole and parse it in memory like standard input
+  if (!IsSeekable(fileno(XbeFile))) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading unseekable Xbe file into memory...");
+
+    bool bRead = ReadStream(fileno(XbeFile), m_Stream);
+
+    fclose(XbeFile);
+    XbeFile = NULL;
+
+    if (!bRead) {
+      SetError("Could not read Xbe file", true);
+      goto cleanup;
+    }
+
+    LogPrintf(LL_INFO, "OK\n");
+
+    ParseImage(m_Stream.data(), (uint32)m_Stream.size());
+
+    return;
+  }
+
+  // keep the file around for sections that are only read when first needed
+  if (x_Mode == LM_LAZY) m_LazyFile = XbeFile;
 
   // read Xbe image header
   {
-    printf("Xbe::Xbe: Reading Image Header...");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Image Header...");
 
     if (fread(&m_Header, sizeof(m_Header), 1, XbeFile) != 1) {
       SetError("Unexpected end of file while reading Xbe Image Header", true);
@@ -76,30 +133,35 @@ Xbe::Xbe(const char *x_szFilename) {
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
   // read Xbe image header extra bytes
   if (m_Header.dwSizeofHeaders > sizeof(m_Header)) {
-    printf("Xbe::Xbe: Reading Image Header Extra Bytes...");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Image Header Extra Bytes...");
 
-    uint32 ExSize = RoundUp(m_Header.dwSizeofHeaders, 0x1000) - sizeof(m_Header);
+    uint32 ExSize = m_Header.dwSizeofHeaders - sizeof(m_Header);
 
-    m_HeaderEx = new char[ExSize];
+    // packed files start their first section right after the headers, so only read that much (the rest of
+    // the page is kept around zeroed)
+    m_HeaderEx = new char[RoundUp(m_Header.dwSizeofHeaders, 0x1000) - sizeof(m_Header)]();
 
     if (fread(m_HeaderEx, ExSize, 1, XbeFile) != 1) {
       SetError("Unexpected end of file while reading Xbe Image Header (Ex)", true);
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
   // read Xbe certificate
   {
-    printf("Xbe::Xbe: Reading Certificate...");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Certificate...");
 
-    fseek(XbeFile, m_Header.dwCertificateAddr - m_Header.dwBaseAddr, SEEK_SET);
+    if (fseek(XbeFile, m_Header.dwCertificateAddr - m_Header.dwBaseAddr, SEEK_SET) != 0) {
+      SetError("Could not seek to Xbe Certificate", true);
+      goto cleanup;
+    }
 
     if (fread(&m_Certificate, sizeof(m_Certificate), 1, XbeFile) != 1) {
       SetError("Unexpected end of file while reading Xbe Certificate", true);
@@ -117,21 +179,24 @@ Xbe::Xbe(const char *x_szFilename) {
     }
     *c = '\0';
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
 
-    printf("Xbe::Xbe: Title identified as %s\n", m_szAsciiTitle);
+    LogPrintf(LL_INFO, "Xbe::Xbe: Title identified as %s\n", m_szAsciiTitle);
   }
 
   // read Xbe section headers
   {
-    printf("Xbe::Xbe: Reading Section Headers...\n");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Section Headers...\n");
 
-    fseek(XbeFile, m_Header.dwSectionHeadersAddr - m_Header.dwBaseAddr, SEEK_SET);
+    if (fseek(XbeFile, m_Header.dwSectionHeadersAddr - m_Header.dwBaseAddr, SEEK_SET) != 0) {
+      SetError("Could not seek to Xbe Section Headers", true);
+      goto cleanup;
+    }
 
     m_SectionHeader = new SectionHeader[m_Header.dwSections];
 
     for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      printf("Xbe::Xbe: Reading Section Header 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Section Header 0x%.04X...", v);
 
       if (fread(&m_SectionHeader[v], sizeof(*m_SectionHeader), 1, XbeFile) != 1) {
         sprintf(szBuffer, "Unexpected end of file while reading Xbe Section Header %d (%Xh)", v, v);
@@ -139,17 +204,24 @@ Xbe::Xbe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      printf("OK\n");
+      LogPrintf(LL_VERBOSE, "OK\n");
     }
+
+    // nothing is loaded yet
+    m_bzSection = new uint08 *[m_Header.dwSections];
+
+    memset(m_bzSection, 0, m_Header.dwSections * sizeof(*m_bzSection));
+
+    IndexSections();
   }
 
   // read Xbe section names
   {
-    printf("Xbe::Xbe: Reading Section Names...\n");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Section Names...\n");
 
     m_szSectionName = new char[m_Header.dwSections][9];
     for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      printf("Xbe::Xbe: Reading Section Name 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Section Name 0x%.04X...", v);
 
       uint08 *sn = GetAddr(m_SectionHeader[v].dwSectionNameAddr);
 
@@ -163,20 +235,23 @@ Xbe::Xbe(const char *x_szFilename) {
         }
       }
 
-      printf("OK (%s)\n", m_szSectionName[v]);
+      LogPrintf(LL_VERBOSE, "OK (%s)\n", m_szSectionName[v]);
     }
   }
 
   // read Xbe library versions
   if (m_Header.dwLibraryVersionsAddr != 0) {
-    printf("Xbe::Xbe: Reading Library Versions...\n");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Library Versions...\n");
 
-    fseek(XbeFile, m_Header.dwLibraryVersionsAddr - m_Header.dwBaseAddr, SEEK_SET);
+    if (fseek(XbeFile, m_Header.dwLibraryVersionsAddr - m_Header.dwBaseAddr, SEEK_SET) != 0) {
+      SetError("Could not seek to Xbe Library Versions", true);
+      goto cleanup;
+    }
 
     m_LibraryVersion = new LibraryVersion[m_Header.dwLibraryVersions];
 
     for (uint32 v = 0; v < m_Header.dwLibraryVersions; v++) {
-      printf("Xbe::Xbe: Reading Library Version 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Library Version 0x%.04X...", v);
 
       if (fread(&m_LibraryVersion[v], sizeof(*m_LibraryVersion), 1, XbeFile) != 1) {
         sprintf(szBuffer, "Unexpected end of file while reading Xbe Library Version %d (%Xh)", v, v);
@@ -184,16 +259,19 @@ Xbe::Xbe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      printf("OK\n");
+      LogPrintf(LL_VERBOSE, "OK\n");
     }
 
     // read Xbe kernel library version
     if (m_Header.dwKernelLibraryVersionAddr == 0) {
-      printf("Xbe::Xbe: Warning: No Kernel Library Version!\n");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Warning: No Kernel Library Version!\n");
     } else {
-      printf("Xbe::Xbe: Reading Kernel Library Version...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Reading Kernel Library Version...");
 
-      fseek(XbeFile, m_Header.dwKernelLibraryVersionAddr - m_Header.dwBaseAddr, SEEK_SET);
+      if (fseek(XbeFile, m_Header.dwKernelLibraryVersionAddr - m_Header.dwBaseAddr, SEEK_SET) != 0) {
+        SetError("Could not seek to Xbe Kernel Version", true);
+        goto cleanup;
+      }
 
       m_KernelLibraryVersion = new LibraryVersion;
 
@@ -202,16 +280,19 @@ Xbe::Xbe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      printf("OK\n");
+      LogPrintf(LL_INFO, "OK\n");
     }
 
     // read Xbe Xapi library version
     if (m_Header.dwXAPILibraryVersionAddr == 0) {
-      printf("Xbe::Xbe: Warning: No Xapi Library Version!\n");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Warning: No Xapi Library Version!\n");
     } else {
-      printf("Xbe::Xbe: Reading Xapi Library Version...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Reading Xapi Library Version...");
 
-      fseek(XbeFile, m_Header.dwXAPILibraryVersionAddr - m_Header.dwBaseAddr, SEEK_SET);
+      if (fseek(XbeFile, m_Header.dwXAPILibraryVersionAddr - m_Header.dwBaseAddr, SEEK_SET) != 0) {
+        SetError("Could not seek to Xbe Xapi Version", true);
+        goto cleanup;
+      }
 
       m_XAPILibraryVersion = new LibraryVersion;
 
@@ -220,46 +301,42 @@ Xbe::Xbe(const char *x_szFilename) {
         goto cleanup;
       }
 
-      printf("OK\n");
+      LogPrintf(LL_INFO, "OK\n");
     }
   }
 
-  // read Xbe sections
-  {
-    printf("Xbe::Xbe: Reading Sections...\n");
-
-    m_bzSection = new uint08 *[m_Header.dwSections];
-
-    memset(m_bzSection, 0, m_Header.dwSections);
+  // read Xbe sections (unless they are to be read on first access)
+  if (x_Mode == LM_LAZY) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Deferring Sections until first access\n");
+  } else {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Sections...\n");
 
     for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      printf("Xbe::Xbe: Reading Section 0x%.04X...", v);
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Section 0x%.04X...", v);
 
       uint32 RawSize = m_SectionHeader[v].dwSizeofRaw;
       uint32 RawAddr = m_SectionHeader[v].dwRawAddr;
 
       m_bzSection[v] = new uint08[RawSize];
 
-      fseek(XbeFile, RawAddr, SEEK_SET);
-
       if (RawSize == 0) {
-        printf("OK\n");
+        LogPrintf(LL_VERBOSE, "OK\n");
         continue;
       }
 
-      if (fread(m_bzSection[v], RawSize, 1, XbeFile) != 1) {
+      if (fseek(XbeFile, RawAddr, SEEK_SET) != 0 || fread(m_bzSection[v], RawSize, 1, XbeFile) != 1) {
         sprintf(szBuffer, "Unexpected end of file while reading Xbe Section %d (%Xh) (%s)", v, v, m_szSectionName[v]);
         SetError(szBuffer, true);
         goto cleanup;
       }
 
-      printf("OK\n");
+      LogPrintf(LL_VERBOSE, "OK\n");
     }
   }
 
   // read Xbe thread local storage
   if (m_Header.dwTLSAddr != 0) {
-    printf("Xbe::Xbe: Reading Thread Local Storage...");
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Thread Local Storage...");
 
     void *Addr = GetAddr(m_Header.dwTLSAddr);
 
@@ -272,17 +349,17 @@ Xbe::Xbe(const char *x_szFilename) {
 
     memcpy(m_TLS, Addr, sizeof(*m_TLS));
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
 cleanup:
 
   if (GetError() != 0) {
-    printf("FAILED!\n");
-    printf("Xbe::Xbe: ERROR -> %s\n", GetError());
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::Xbe: ERROR -> %s\n", GetError());
   }
 
-  if (XbeFile != NULL) {
+  if (XbeFile != NULL && XbeFile != m_LazyFile) {
     fclose(XbeFile);
     XbeFile = NULL;
   }
@@ -290,15 +367,255 @@ cleanup:
   return;
 }
 
+// construct via Xbe image already in memory
+Xbe::Xbe(uint08 *x_pImage, uint32 x_dwSize) {
+  ConstructorInit();
+
+  ParseImage(x_pImage, x_dwSize);
+}
+
+// parse an Xbe image that is already in memory, pointing into it instead of copying
+void Xbe::ParseImage(uint08 *x_pImage, uint32 x_dwSize) {
+  char szBuffer[260];
+
+  m_pImage = x_pImage;
+  m_dwImageSize = x_dwSize;
+
+  // read Xbe image header
+  {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Image Header...");
+
+    if (x_dwSize < sizeof(m_Header)) {
+      SetError("Unexpected end of file while reading Xbe Image Header", true);
+      goto cleanup;
+    }
+
+    memcpy(&m_Header, x_pImage, sizeof(m_Header));
+
+    if (m_Header.dwMagic != *(uint32 *)"XBEH") {
+      SetError("Invalid magic number in Xbe file", true);
+      goto cleanup;
+    }
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // locate Xbe image header extra bytes
+  if (m_Header.dwSizeofHeaders > sizeof(m_Header)) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Image Header Extra Bytes...");
+
+    if (m_Header.dwSizeofHeaders > x_dwSize) {
+      SetError("Unexpected end of file while reading Xbe Image Header (Ex)", true);
+      goto cleanup;
+    }
+
+    m_HeaderEx = (char *)&x_pImage[sizeof(m_Header)];
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // read Xbe certificate (small and fixed size, so this one is copied)
+  {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Certificate...");
+
+    uint32 CertOffs = m_Header.dwCertificateAddr - m_Header.dwBaseAddr;
+
+    if (CertOffs > x_dwSize || x_dwSize - CertOffs < sizeof(m_Certificate)) {
+      SetError("Unexpected end of file while reading Xbe Certificate", true);
+      goto cleanup;
+    }
+
+    memcpy(&m_Certificate, &x_pImage[CertOffs], sizeof(m_Certificate));
+
+    // generate ascii title from certificate title name
+    setlocale(LC_ALL, "English");
+    char *c = m_szAsciiTitle;
+    char *d = (char *)m_Certificate.wszTitleName;
+    while ((uint16 *)d < &m_Certificate.wszTitleName[40] && *d) {
+      *c++ = *d++;
+      d++;
+    }
+    *c = '\0';
+
+    LogPrintf(LL_INFO, "OK\n");
+
+    LogPrintf(LL_INFO, "Xbe::Xbe: Title identified as %s\n", m_szAsciiTitle);
+  }
+
+  // locate Xbe section headers
+  {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Section Headers...");
+
+    uint32 HeadersOffs = m_Header.dwSectionHeadersAddr - m_Header.dwBaseAddr;
+    uint64_t HeadersSize = (uint64_t)m_Header.dwSections * sizeof(*m_SectionHeader);
+
+    if (HeadersOffs > x_dwSize || x_dwSize - HeadersOffs < HeadersSize) {
+      SetError("Unexpected end of file while reading Xbe Section Headers", true);
+      goto cleanup;
+    }
+
+    m_SectionHeader = (SectionHeader *)&x_pImage[HeadersOffs];
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+  // locate Xbe sections
+  {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Sections...\n");
+
+    m_bzSection = new uint08 *[m_Header.dwSections];
+
+    memset(m_bzSection, 0, m_Header.dwSections * sizeof(*m_bzSection));
+
+    for (uint32 v = 0; v < m_Header.dwSections; v++) {
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Section 0x%.04X...", v);
+
+      uint32 RawSize = m_SectionHeader[v].dwSizeofRaw;
+      uint32 RawAddr = m_SectionHeader[v].dwRawAddr;
+
+      if (RawAddr > x_dwSize || x_dwSize - RawAddr < RawSize) {
+        sprintf(szBuffer, "Unexpected end of file while reading Xbe Section %d (%Xh)", v, v);
+        SetError(szBuffer, true);
+        goto cleanup;
+      }
+
+      m_bzSection[v] = &x_pImage[RawAddr];
+
+      LogPrintf(LL_VERBOSE, "OK\n");
+    }
+
+    IndexSections();
+  }
+
+  // read Xbe section names
+  {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Section Names...\n");
+
+    m_szSectionName = new char[m_Header.dwSections][9];
+    for (uint32 v = 0; v < m_Header.dwSections; v++) {
+      LogPrintf(LL_VERBOSE, "Xbe::Xbe: Reading Section Name 0x%.04X...", v);
+
+      uint08 *sn = GetAddr(m_SectionHeader[v].dwSectionNameAddr);
+
+      memset(m_szSectionName[v], 0, 9);
+
+      if (sn != 0) {
+        for (int b = 0; b < 8; b++) {
+          m_szSectionName[v][b] = sn[b];
+
+          if (m_szSectionName[v][b] == '\0') break;
+        }
+      }
+
+      LogPrintf(LL_VERBOSE, "OK (%s)\n", m_szSectionName[v]);
+    }
+  }
+
+  // locate Xbe library versions
+  if (m_Header.dwLibraryVersionsAddr != 0) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Library Versions...");
+
+    uint32 VersionsOffs = m_Header.dwLibraryVersionsAddr - m_Header.dwBaseAddr;
+    uint64_t VersionsSize = (uint64_t)m_Header.dwLibraryVersions * sizeof(*m_LibraryVersion);
+
+    if (VersionsOffs > x_dwSize || x_dwSize - VersionsOffs < VersionsSize) {
+      SetError("Unexpected end of file while reading Xbe Library Versions", true);
+      goto cleanup;
+    }
+
+    m_LibraryVersion = (LibraryVersion *)&x_pImage[VersionsOffs];
+
+    LogPrintf(LL_INFO, "OK\n");
+
+    // locate Xbe kernel library version
+    if (m_Header.dwKernelLibraryVersionAddr == 0) {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Warning: No Kernel Library Version!\n");
+    } else {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Reading Kernel Library Version...");
+
+      uint32 KernelOffs = m_Header.dwKernelLibraryVersionAddr - m_Header.dwBaseAddr;
+
+      if (KernelOffs > x_dwSize || x_dwSize - KernelOffs < sizeof(*m_LibraryVersion)) {
+        SetError("Unexpected end of file while reading Xbe Kernel Version", true);
+        goto cleanup;
+      }
+
+      m_KernelLibraryVersion = (LibraryVersion *)&x_pImage[KernelOffs];
+
+      LogPrintf(LL_INFO, "OK\n");
+    }
+
+    // locate Xbe Xapi library version
+    if (m_Header.dwXAPILibraryVersionAddr == 0) {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Warning: No Xapi Library Version!\n");
+    } else {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Reading Xapi Library Version...");
+
+      uint32 XapiOffs = m_Header.dwXAPILibraryVersionAddr - m_Header.dwBaseAddr;
+
+      if (XapiOffs > x_dwSize || x_dwSize - XapiOffs < sizeof(*m_LibraryVersion)) {
+        SetError("Unexpected end of file while reading Xbe Xapi Version", true);
+        goto cleanup;
+      }
+
+      m_XAPILibraryVersion = (LibraryVersion *)&x_pImage[XapiOffs];
+
+      LogPrintf(LL_INFO, "OK\n");
+    }
+  }
+
+  // locate Xbe thread local storage
+  if (m_Header.dwTLSAddr != 0) {
+    LogPrintf(LL_INFO, "Xbe::Xbe: Reading Thread Local Storage...");
+
+    m_TLS = (TLS *)GetAddr(m_Header.dwTLSAddr);
+
+    if (m_TLS == 0) {
+      SetError("Could not locate Thread Local Storage", true);
+      goto cleanup;
+    }
+
+    LogPrintf(LL_INFO, "OK\n");
+  }
+
+cleanup:
+
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::Xbe: ERROR -> %s\n", GetError());
+  }
+
+  return;
+}
+
 // construct via Exe file object
-Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
+Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout) {
+  ConstructorInit();
+
+  ConvertExe(x_Exe, x_szTitle, x_bRetail, x_dwLayout, false);
+}
+
+// construct via Exe file object that is given up
+Xbe::Xbe(std::unique_ptr<class Exe> x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout) {
   ConstructorInit();
 
+  ConvertExe(x_Exe.get(), x_szTitle, x_bRetail, x_dwLayout, true);
+}
+
+// convert an Exe, taking over its section buffers if x_bAdopt is set
+void Xbe::ConvertExe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout, bool x_bAdopt) {
   time_t CurrentTime;
 
+  m_dwLayout = x_dwLayout;
+
+  // head/tail reference count words (shared pages may need one for every boundary page)
+  uint32 dwRefCounts = x_Exe->m_Header.m_sections + 1;
+
+  if (x_dwLayout & XL_SHARE_PAGES) dwRefCounts = x_Exe->m_Header.m_sections * 2;
+
   time(&CurrentTime);
 
-  printf("Xbe::Xbe: Pass 1 (Simple Pass)...");
+  LogPrintf(LL_INFO, "Xbe::Xbe: Pass 1 (Simple Pass)...");
 
   // pass 1
   {
@@ -351,9 +668,9 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
     m_Header.dwXAPILibraryVersionAddr = 0;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
 
-  printf("Xbe::Xbe: Pass 2 (Calculating Requirements)...");
+  LogPrintf(LL_INFO, "Xbe::Xbe: Pass 2 (Calculating Requirements)...");
 
   // pass 2
   {
@@ -374,7 +691,7 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
       mrc += m_Header.dwSections * (sizeof(*m_SectionHeader));
 
       // make room for head/tail reference count words
-      mrc += (m_Header.dwSections + 1) * 2;
+      mrc += dwRefCounts * 2;
 
       // make room for section names
       for (uint32 v = 0; v < m_Header.dwSections; v++) {
@@ -406,13 +723,15 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
       mrc += 2;
     }
 
-    // make room for largest possible logo bitmap
+    // make room for largest possible logo bitmap (or, packed, just the one we write)
     {
       mrc = RoundUp(mrc, 0x10);
 
       m_Header.dwLogoBitmapAddr = mrc;
       m_Header.dwSizeofLogoBitmap = 100 * 17;  // Max Possible
 
+      if (x_dwLayout & XL_PACK_FILE) m_Header.dwSizeofLogoBitmap = dwSizeOfOpenXDK;
+
       mrc += m_Header.dwSizeofLogoBitmap;
     }
 
@@ -420,20 +739,31 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
     m_Header.dwSizeofHeaders = mrc - m_Header.dwBaseAddr;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
 
-  printf("Xbe::Xbe: Pass 3 (Generating Xbe)...\n");
+  LogPrintf(LL_INFO, "Xbe::Xbe: Pass 3 (Generating Xbe)...\n");
 
   // pass 3
   {
     m_Header.dwPeBaseAddr =
         m_Header.dwBaseAddr + RoundUp(m_Header.dwSizeofHeaders, 0x1000) - x_Exe->m_SectionHeader[0].m_virtual_addr;
 
+    // move data sections down to share boundary pages (everything below is placed through MoveRVA)
+    if (x_dwLayout & XL_SHARE_PAGES) {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Sharing Section Pages (data keeps alignments up to %d bytes)...", XBE_SHARED_ALIGN);
+
+      uint32 dwSaved = ShareSectionPages(x_Exe);
+
+      if (GetError() != 0) goto cleanup;
+
+      LogPrintf(LL_INFO, "OK (%d Bytes Of Memory Saved)\n", dwSaved);
+    }
+
     // encode entry point
     {
-      printf("Xbe::Xbe: Encoding %s Entry Point...", x_bRetail ? "Retail" : "Debug");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Encoding %s Entry Point...", x_bRetail ? "Retail" : "Debug");
 
-      uint32 ep = x_Exe->m_OptionalHeader.m_entry + m_Header.dwPeBaseAddr;
+      uint32 ep = MoveRVA(x_Exe->m_OptionalHeader.m_entry) + m_Header.dwPeBaseAddr;
 
       if (x_bRetail)
         ep ^= XOR_EP_RETAIL;
@@ -442,19 +772,72 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
 
       m_Header.dwEntryAddr = ep;
 
-      printf("OK (0x%.08X)\n", ep);
+      LogPrintf(LL_INFO, "OK (0x%.08X)\n", ep);
     }
 
     {
-      printf("Xbe::Xbe: Relocating TLS directory...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Relocating TLS directory...");
 
       uint32 tls_directory = x_Exe->m_OptionalHeader.m_image_data_directory[IMAGE_DIRECTORY_ENTRY_TLS].m_virtual_addr;
       if (!tls_directory)
         m_Header.dwTLSAddr = 0;
       else
-        m_Header.dwTLSAddr = tls_directory + m_Header.dwPeBaseAddr;
+        m_Header.dwTLSAddr = MoveRVA(tls_directory) + m_Header.dwPeBaseAddr;
+
+      LogPrintf(LL_INFO, "OK (0x%.08X)\n", m_Header.dwTLSAddr);
+    }
+
+    // locate kernel thunk table (the Exe's sections are still intact here)
+    {
+      LogPrintf(LL_INFO, "Xbe::Xbe: Reading Import Directory...");
+
+      ImportDirectory Imports(x_Exe);
+
+      if (Imports.GetError() != 0) {
+        SetError(Imports.GetError(), true);
+        goto cleanup;
+      }
+
+      LogPrintf(LL_INFO, "OK (%d Libraries, %d Imports)\n", (int)Imports.GetLibraries().size(), Imports.GetImports());
+
+      // the kernel is the only library an Xbe can import from, and the Xbox loader only resolves its ordinals
+      const ImportDirectory::Library *Kernel = Imports.Find("xboxkrnl.exe");
 
-      printf("OK (0x%.08X)\n", m_Header.dwTLSAddr);
+      for (const ImportDirectory::Library &Lib : Imports.GetLibraries()) {
+        if (&Lib != Kernel) {
+          LogPrintf(LL_INFO, "Xbe::Xbe: Warning: Imports from %s cannot be resolved!\n", Lib.Name.c_str());
+          continue;
+        }
+
+        for (const ImportDirectory::Import &Imp : Lib.Imports) {
+          if (!Imp.Name.empty())
+            LogPrintf(LL_INFO, "Xbe::Xbe: Warning: Kernel export %s (ordinal %d) is imported by name!\n",
+                      Imp.Name.c_str(), KernelExportOrdinal(Imp.Name.c_str()));
+          else if (KernelExportName(Imp.dwOrdinal) == nullptr)
+            LogPrintf(LL_INFO, "Xbe::Xbe: Warning: Unknown kernel export ordinal %d!\n", Imp.dwOrdinal);
+          else
+            LogPrintf(LL_VERBOSE, "Xbe::Xbe: Kernel Import %d (%s)\n", Imp.dwOrdinal, KernelExportName(Imp.dwOrdinal));
+        }
+      }
+
+      // unfortunately, GCC doesn't populate the IAT entry in the data directory
+      // so if the value is 0, then it could mean there are no imports, or it
+      // could mean the EXE was compiled by GCC
+      uint32 ktRVA = x_Exe->m_OptionalHeader.m_image_data_directory[IMAGE_DIRECTORY_ENTRY_IAT].m_virtual_addr;
+
+      // if so, use the kernel's import address table (or the first library's, if there is no kernel import)
+      if (ktRVA == 0) {
+        if (Kernel != nullptr)
+          ktRVA = Kernel->dwThunkRVA;
+        else if (!Imports.GetLibraries().empty())
+          ktRVA = Imports.GetLibraries()[0].dwThunkRVA;
+      }
+
+      uint32 kt = MoveRVA(ktRVA) + m_Header.dwPeBaseAddr;
+
+      kt ^= (x_bRetail ? XOR_KT_RETAIL : XOR_KT_DEBUG);
+
+      m_Header.dwKernelImageThunkAddr = kt;
     }
 
     // header write cursor
@@ -462,13 +845,14 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
 
     // check if we need to store extra header bytes (we always will)
     if (m_Header.dwSizeofHeaders > sizeof(m_Header)) {
-      printf("Xbe::Xbe: Found Extra Header Bytes...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Found Extra Header Bytes...");
 
       uint32 ExSize = RoundUp(m_Header.dwSizeofHeaders - sizeof(m_Header), 0x1000);
 
-      m_HeaderEx = new char[ExSize];
+      // zeroed so that alignment gaps between the header tables are written out as zeros
+      m_HeaderEx = new char[ExSize]();
 
-      printf("OK\n");
+      LogPrintf(LL_INFO, "OK\n");
     }
 
     // start a write buffer inside of m_HeaderEx
@@ -550,26 +934,48 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
     {
       m_szSectionName = new char[m_Header.dwSections][9];
 
-      m_SectionHeader = new SectionHeader[m_Header.dwSections];
+      // the section headers are filled in where they are written out, so that m_HeaderEx is never behind
+      // anything set on them later (digests, shared page flags)
+      m_SectionHeader = (SectionHeader *)szBuffer;
 
-      uint32 SectionCursor = RoundUp(m_Header.dwSizeofHeaders, 0x1000);
+      uint32 SectionCursor = RoundUp(m_Header.dwSizeofHeaders, (x_dwLayout & XL_PACK_FILE) ? 4 : 0x1000);
 
       // head/tail reference count write buffer
       uint16 *htrc = (uint16 *)(szBuffer + m_Header.dwSections * sizeof(*m_SectionHeader));
 
       // section write buffer
-      char *secn = (char *)((uintptr_t)htrc + (m_Header.dwSections + 1) * 2);
+      char *secn = (char *)((uintptr_t)htrc + dwRefCounts * 2);
 
       // head/tail reference count write cursor
       uint32 hwc_htrc = hwc + m_Header.dwSections * sizeof(*m_SectionHeader);
 
+      uint32 dwRefCountAddr = hwc_htrc;
+
       // section write cursor
-      uint32 hwc_secn = hwc_htrc + (m_Header.dwSections + 1) * 2;
+      uint32 hwc_secn = hwc_htrc + dwRefCounts * 2;
 
-      printf("Xbe::Xbe: Generating Section Headers...\n");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Generating Section Headers...\n");
+
+      // trim every section up front, in parallel, so the layout below is just arithmetic
+      std::vector<uint32> SizeofRaw(m_Header.dwSections);
+
+      ThreadPool::Get().ParallelFor(m_Header.dwSections, 1, [&](uint32 x_dwBegin, uint32 x_dwEnd) {
+        for (uint32 v = x_dwBegin; v < x_dwEnd; v++) {
+          // calculate sizeof_raw by locating the last non-zero value in the raw section data
+          // (anything past the data the Exe holds is zero anyway)
+          uint32 r = x_Exe->m_SectionHeader[v].m_sizeof_raw;
+
+          if (r > x_Exe->m_dwSectionSize[v]) r = x_Exe->m_dwSectionSize[v];
+
+          r = TrimZeros(x_Exe->m_bzSection[v], r);
+
+          // word aligned, and never less than one word
+          SizeofRaw[v] = RoundUp(r < 2 ? 2 : r, 4);
+        }
+      });
 
       for (uint32 v = 0; v < m_Header.dwSections; v++) {
-        printf("Xbe::Xbe: Generating Section Header %.04X...", v);
+        LogPrintf(LL_VERBOSE, "Xbe::Xbe: Generating Section Header %.04X...", v);
 
         uint32 characteristics = x_Exe->m_SectionHeader[v].m_characteristics;
 
@@ -581,31 +987,27 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
           m_SectionHeader[v].dwFlags.bExecutable = true;
 
         m_SectionHeader[v].dwFlags.bPreload = true;
-        m_SectionHeader[v].dwVirtualAddr = x_Exe->m_SectionHeader[v].m_virtual_addr + m_Header.dwPeBaseAddr;
+        m_SectionHeader[v].dwVirtualAddr = MoveRVA(x_Exe->m_SectionHeader[v].m_virtual_addr) + m_Header.dwPeBaseAddr;
+
+        if (!m_SectionMove.empty()) {
+          // a shared page must not be overwritten by raw data past the end of the section
+          m_SectionHeader[v].dwVirtualSize = m_SectionMove[v].dwSize;
 
-        if (v < m_Header.dwSections - 1)
+          if (SizeofRaw[v] > m_SectionMove[v].dwSize) SizeofRaw[v] = m_SectionMove[v].dwSize;
+        } else if (v < m_Header.dwSections - 1)
           m_SectionHeader[v].dwVirtualSize =
               x_Exe->m_SectionHeader[v + 1].m_virtual_addr - x_Exe->m_SectionHeader[v].m_virtual_addr;
         else
           m_SectionHeader[v].dwVirtualSize = RoundUp(x_Exe->m_SectionHeader[v].m_virtual_size, 4);
 
         m_SectionHeader[v].dwRawAddr = SectionCursor;
+        m_SectionHeader[v].dwSizeofRaw = SizeofRaw[v];
 
-        // calculate sizeof_raw by locating the last non-zero value in the raw section data
-        {
-          uint32 r = x_Exe->m_SectionHeader[v].m_sizeof_raw;
-          if (r > 0) {
-            r--;
-            while (r > 0) {
-              if (x_Exe->m_bzSection[v][r--] != 0) break;
-            }
-          }
-
-          // word aligned
-          m_SectionHeader[v].dwSizeofRaw = RoundUp(r + 2, 4);
-        }
-
-        SectionCursor += RoundUp(m_SectionHeader[v].dwSizeofRaw, 0x1000);
+        // the loader reads every section on its own, so packed raw data need only stay word aligned
+        if (x_dwLayout & XL_PACK_FILE)
+          SectionCursor += m_SectionHeader[v].dwSizeofRaw;
+        else
+          SectionCursor += RoundUp(m_SectionHeader[v].dwSizeofRaw, 0x1000);
 
         // head/tail reference count
         {
@@ -638,15 +1040,59 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
 
         m_SectionHeader[v].dwSectionRefCount = 0;
 
-        // write section digest (just zeros)
+        // write section digest (zeros until the section data is final)
         memset(m_SectionHeader[v].bzSectionDigest, 0, 20);
 
-        // write section header
-        memcpy(szBuffer, &m_SectionHeader[v], sizeof(*m_SectionHeader));
-
         szBuffer += sizeof(*m_SectionHeader);
 
-        printf("OK\n");
+        LogPrintf(LL_VERBOSE, "OK\n");
+      }
+
+      // sections whose boundary pages coincide count them with the same word, and such a page may
+      // only be made read only if none of the sections on it is writable
+      if (!m_SectionMove.empty()) {
+        std::map<uint32, bool> PageWritable;
+
+        for (uint32 v = 0; v < m_Header.dwSections; v++) {
+          uint32 dwHead = m_SectionHeader[v].dwVirtualAddr & ~0xFFF;
+          uint32 dwTail = (m_SectionHeader[v].dwVirtualAddr + m_SectionHeader[v].dwVirtualSize - 1) & ~0xFFF;
+
+          PageWritable[dwHead] |= m_SectionHeader[v].dwFlags.bWritable;
+          PageWritable[dwTail] |= m_SectionHeader[v].dwFlags.bWritable;
+        }
+
+        uint32 dwWords = 0;
+        uint32 dwLastPage = 0;
+
+        for (uint32 v = 0; v < m_Header.dwSections; v++) {
+          uint32 dwHead = m_SectionHeader[v].dwVirtualAddr & ~0xFFF;
+          uint32 dwTail = (m_SectionHeader[v].dwVirtualAddr + m_SectionHeader[v].dwVirtualSize - 1) & ~0xFFF;
+
+          if (dwWords == 0 || dwHead != dwLastPage) dwWords++;
+
+          m_SectionHeader[v].dwHeadSharedRefCountAddr = dwRefCountAddr + (dwWords - 1) * 2;
+
+          if (dwTail != dwHead) dwWords++;
+
+          m_SectionHeader[v].dwTailSharedRefCountAddr = dwRefCountAddr + (dwWords - 1) * 2;
+
+          m_SectionHeader[v].dwFlags.bHeadPageRO = !PageWritable[dwHead];
+          m_SectionHeader[v].dwFlags.bTailPageRO = !PageWritable[dwTail];
+
+          dwLastPage = dwTail;
+        }
+      }
+
+      IndexSections();
+
+      // what the default layout would have taken: the largest logo, and every section padded to a page
+      if (x_dwLayout & XL_PACK_FILE) {
+        uint32 DefaultSize = RoundUp(m_Header.dwLogoBitmapAddr - m_Header.dwBaseAddr + 100 * 17, 0x1000);
+
+        for (uint32 v = 0; v < m_Header.dwSections; v++) DefaultSize += RoundUp(m_SectionHeader[v].dwSizeofRaw, 0x1000);
+
+        LogPrintf(LL_INFO, "Xbe::Xbe: Packed Layout Takes %d Bytes, Saving %d Bytes\n", SectionCursor,
+                  DefaultSize - SectionCursor);
       }
 
       hwc = hwc_secn;
@@ -658,7 +1104,7 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
       m_LibraryVersion = new LibraryVersion[m_Header.dwLibraryVersions];
 
       for (uint32 v = 0; v < m_Header.dwLibraryVersions; ++v) {
-        char tmp[9];
+        char tmp[9] = {0};
 
         snprintf(tmp, sizeof(tmp), "CXBE%d", v);
 
@@ -690,42 +1136,63 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
 
     // write default "OpenXDK" logo bitmap
     {
-      printf("Xbe::Xbe: Generating \"OpenXDK\" Logo Bitmap...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Generating \"OpenXDK\" Logo Bitmap...");
 
       uint08 *RawAddr = GetAddr(m_Header.dwLogoBitmapAddr);
 
-      memset(RawAddr, 0, 100 * 17);
+      memset(RawAddr, 0, m_Header.dwSizeofLogoBitmap);
 
       memcpy(RawAddr, OpenXDK, dwSizeOfOpenXDK);
 
       m_Header.dwSizeofLogoBitmap = dwSizeOfOpenXDK;
 
-      printf("OK\n");
+      LogPrintf(LL_INFO, "OK\n");
     }
 
     // write sections
     {
-      printf("Xbe::Xbe: Generating Sections...\n");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Generating Sections...\n");
+
+      m_bzSection = new uint08 *[m_Header.dwSections]();
 
-      m_bzSection = new uint08 *[m_Header.dwSections];
+      // sections that live in the Exe's mapping stay there, so the mapping has to live as long as we do
+      if (x_bAdopt && x_Exe->GetFile() != nullptr) {
+        m_File = x_Exe->GetFile();
+        m_pImage = m_File->GetData();
+        m_dwImageSize = m_File->GetSize();
+      }
 
-      memset(m_bzSection, 0, m_Header.dwSections);
+      // adopted buffers already hold the section's data (anything past dwSizeofRaw is never looked at)
+      std::vector<uint08> Adopted(m_Header.dwSections);
 
       for (uint32 v = 0; v < m_Header.dwSections; v++) {
-        printf("Xbe::Xbe: Generating Section %.04X...", v);
+        if (x_bAdopt) m_bzSection[v] = x_Exe->ReleaseSection(v, m_SectionHeader[v].dwSizeofRaw);
+
+        Adopted[v] = m_bzSection[v] != 0;
 
-        uint32 RawSize = m_SectionHeader[v].dwSizeofRaw;
+        if (!Adopted[v]) m_bzSection[v] = new uint08[m_SectionHeader[v].dwSizeofRaw];
+      }
 
-        m_bzSection[v] = new uint08[RawSize];
+      // each section is copied independently, so the copies are spread over the pool
+      ThreadPool::Get().ParallelFor(m_Header.dwSections, 1, [&](uint32 x_dwBegin, uint32 x_dwEnd) {
+        for (uint32 v = x_dwBegin; v < x_dwEnd; v++) {
+          if (Adopted[v]) continue;
 
-        memcpy(m_bzSection[v], x_Exe->m_bzSection[v], RawSize);
+          uint32 RawSize = m_SectionHeader[v].dwSizeofRaw;
+          uint32 ExeSize = x_Exe->m_dwSectionSize[v] < RawSize ? x_Exe->m_dwSectionSize[v] : RawSize;
 
-        printf("OK\n");
-      }
+          // the trimmed size can run a few bytes past the Exe's raw data, which reads as zeros
+          memcpy(m_bzSection[v], x_Exe->m_bzSection[v], ExeSize);
+          memset(m_bzSection[v] + ExeSize, 0, RawSize - ExeSize);
+        }
+      });
+
+      for (uint32 v = 0; v < m_Header.dwSections; v++)
+        LogPrintf(LL_VERBOSE, "Xbe::Xbe: Generating Section %.04X...%s\n", v, Adopted[v] ? "OK (Adopted)" : "OK");
     }
   }
 
-  printf("Xbe::Xbe: Pass 4 (Finalizing)...\n");
+  LogPrintf(LL_INFO, "Xbe::Xbe: Pass 4 (Finalizing)...\n");
 
   // pass 4
   {
@@ -734,93 +1201,66 @@ Xbe::Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail) {
 
     // relocate to base : 0x00010000
     {
-      printf("Xbe::Xbe: Relocating to Base 0x00010000...");
+      LogPrintf(LL_INFO, "Xbe::Xbe: Relocating to Base 0x00010000...");
 
-      uint32 fixCount = 0;
+      Relocation::Stats Stats;
+      uint32 dwThreads = 1;
 
       uint32 relo_addr = x_Exe->m_OptionalHeader.m_image_data_directory[5].m_virtual_addr;
       uint32 relo_size = x_Exe->m_OptionalHeader.m_image_data_directory[5].m_size;
 
       uint32 dwBaseDiff = m_Header.dwPeBaseAddr - x_Exe->m_OptionalHeader.m_image_base;
 
-      uint08 *reloc = GetAddr(relo_addr + m_Header.dwPeBaseAddr);
+      Relocation::Target Table = RelocationTarget(this, relo_addr);
 
       // relocate, if necessary
-      if (reloc != 0) {
-        uint32 v = 0;
+      if (Table.pData != 0) {
+        Relocation Reloc(Table.pData, relo_size < Table.dwSize ? relo_size : Table.dwSize);
 
-        // relocate each relocation block
-        while (v < relo_size) {
-          uint32 block_addr = *(uint32 *)&reloc[v + 0];
-          uint32 block_stop = *(uint32 *)&reloc[v + 4] + v;
+        // moved sections each have a delta of their own
+        if (!m_SectionMove.empty()) Reloc.SetRebaser(RelocationValue);
 
-          v += 8;
+        Reloc.Apply(dwBaseDiff, RelocationTarget, this);
 
-          // relocate each rva
-          while (v < block_stop && v < relo_size) {
-            uint16 data = *(uint16 *)&reloc[v];
-
-            uint32 type = (data & 0xF000) >> 12;
-
-            if (type == 0) {
-              v += 2;
-              break;
-            }
-
-            // 32-bit field relocation
-            if (type == IMAGE_REL_BASED_HIGHLOW) {
-              fixCount++;
-
-              uint32 dwFixAddr = block_addr + (data & 0x0FFF) + m_Header.dwPeBaseAddr;
-
-              uint08 *bzModRVA = GetAddr(dwFixAddr);
-
-              if (bzModRVA != 0) *(uint32 *)bzModRVA += dwBaseDiff;
-            } else {
-              SetError("Unsupported relocation type", true);
-              goto cleanup;
-            }
-
-            v += 2;
-          }
+        if (Reloc.GetError() != 0) {
+          SetError(Reloc.GetError(), true);
+          goto cleanup;
         }
+
+        Stats = Reloc.GetStats();
+        dwThreads = Reloc.GetThreads();
       }
 
-      printf("OK (%d Fixups)\n", fixCount);
+      LogPrintf(LL_INFO, "OK (%d Fixups)\n", Stats.GetFixups());
+
+      LogPrintf(LL_VERBOSE,
+                "Xbe::Xbe: %d Blocks on %d Thread(s): %d HIGHLOW, %d HIGH, %d LOW, %d HIGHADJ, %d Outside Raw Data\n",
+                Stats.dwBlocks, dwThreads, Stats.dwHighLow, Stats.dwHigh, Stats.dwLow, Stats.dwHighAdj, Stats.dwSkipped);
     }
 
-    // locate kernel thunk table
+    // section digests, now that the sections hold what will be written
     {
-      // unfortunately, GCC doesn't populate the IAT entry in the data directory
-      // so if the value is 0, then it could mean there are no imports, or it
-      // could mean the EXE was compiled by GCC
-      uint32 ktRVA = x_Exe->m_OptionalHeader.m_image_data_directory[12].m_virtual_addr;
-
-      if (ktRVA == 0) {
-        // lets check to see if there is an import section. if so, look at offset 16
-        // for the RVA of the Import Address Table
-        uint32 importRVA = x_Exe->m_OptionalHeader.m_image_data_directory[1].m_virtual_addr;
+      LogPrintf(LL_INFO, "Xbe::Xbe: Calculating Section Digests...");
 
-        if (importRVA != 0) {
-          uint08 *importSection = GetAddr(importRVA + m_Header.dwPeBaseAddr);
+      std::vector<uint08> Digests(m_Header.dwSections * SHA1_DIGEST_SIZE);
 
-          ktRVA = *(uint32 *)&importSection[16];
-        }
+      if (!CalcSectionDigests(Digests.data())) {
+        SetError("Could not read section data", true);
+        goto cleanup;
       }
 
-      uint32 kt = ktRVA + m_Header.dwPeBaseAddr;
-
-      kt ^= (x_bRetail ? XOR_KT_RETAIL : XOR_KT_DEBUG);
+      for (uint32 v = 0; v < m_Header.dwSections; v++)
+        memcpy(m_SectionHeader[v].bzSectionDigest, &Digests[v * SHA1_DIGEST_SIZE], SHA1_DIGEST_SIZE);
 
-      m_Header.dwKernelImageThunkAddr = kt;
+      LogPrintf(LL_INFO, "OK (%s)\n", Sha1Engine());
     }
   }
 
 cleanup:
 
   if (GetError() != 0) {
-    printf("FAILED!\n");
-    printf("Xbe::Xbe: ERROR -> %s\n", GetError());
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::Xbe: ERROR -> %s\n", GetError());
   }
 
   return;
@@ -828,161 +1268,176 @@ cleanup:
 
 // deconstructor
 Xbe::~Xbe() {
+  // anything pointing into the in-memory image is released along with it
   if (m_bzSection != 0) {
-    for (uint32 v = 0; v < m_Header.dwSections; v++) delete[] m_bzSection[v];
+    for (uint32 v = 0; v < m_Header.dwSections; v++)
+      if (!IsImageBuffer(m_bzSection[v])) delete[] m_bzSection[v];
 
     delete[] m_bzSection;
   }
 
-  delete m_XAPILibraryVersion;
-  delete m_KernelLibraryVersion;
-  delete[] m_LibraryVersion;
-  delete m_TLS;
+  if (!IsImageBuffer(m_XAPILibraryVersion)) delete m_XAPILibraryVersion;
+  if (!IsImageBuffer(m_KernelLibraryVersion)) delete m_KernelLibraryVersion;
+  if (!IsImageBuffer(m_LibraryVersion)) delete[] m_LibraryVersion;
+  if (!IsImageBuffer(m_TLS)) delete m_TLS;
   delete[] m_szSectionName;
-  delete[] m_SectionHeader;
-  delete[] m_HeaderEx;
+
+  // an Xbe converted from an Exe keeps its section headers in m_HeaderEx
+  bool bInHeaderEx = m_HeaderEx != 0 && (char *)m_SectionHeader >= m_HeaderEx &&
+                     (char *)m_SectionHeader < m_HeaderEx + m_Header.dwSizeofHeaders;
+
+  if (!IsImageBuffer(m_SectionHeader) && !bInHeaderEx) delete[] m_SectionHeader;
+  if (!IsImageBuffer(m_HeaderEx)) delete[] m_HeaderEx;
+
+  if (m_LazyFile != 0) fclose(m_LazyFile);
 }
 
 // export to Xbe file
-void Xbe::Export(const char *x_szXbeFilename) {
+void Xbe::Export(const char *x_szXbeFilename, ExportDigest *x_Digest) {
   if (GetError() != 0) return;
 
-  char szBuffer[260];
+  ExportPlan Plan;
+
+  LogPrintf(LL_INFO, "Xbe::Export: Opening Xbe file...");
 
-  printf("Xbe::Export: Writing Xbe file...");
+  // written under a temporary name and renamed into place, as the file may well be the one this Xbe is mapped from
+  std::string szTemp;
 
-  FILE *XbeFile = fopen(x_szXbeFilename, "wb");
+  int XbeFile = OpenReplacement(x_szXbeFilename, szTemp);
 
   // verify Xbe file was opened successfully
-  if (XbeFile == NULL) {
+  if (XbeFile < 0) {
     SetError("Could not open Xbe file", true);
     goto cleanup;
   }
 
-  printf("OK\n");
+  LogPrintf(LL_INFO, "OK\n");
 
-  // write Xbe image header
+  // lay out the whole file before writing any of it
   {
-    printf("Xbe::Export: Writing Image Header...");
+    LogPrintf(LL_INFO, "Xbe::Export: Planning Layout...");
 
-    if (fwrite(&m_Header, sizeof(m_Header), 1, XbeFile) != 1) {
-      SetError("Unexpected write error while writing Xbe Image Header", false);
-      goto cleanup;
-    }
+    PlanExport(Plan, x_Digest);
+
+    // lazily loaded sections are read while planning
+    if (GetError() != 0) goto cleanup;
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
+  }
 
-    printf("Xbe::Export: Writing Image Header Extra Bytes...");
+  // emit the file front to back
+  {
+    LogPrintf(LL_INFO, "Xbe::Export: Writing Xbe file...");
 
-    if (fwrite(m_HeaderEx, m_Header.dwSizeofHeaders, 1, XbeFile) != 1) {
-      SetError("Unexpected write error while writing Xbe Image Header (Ex)", false);
+    if (!Plan.Write(XbeFile)) {
+      SetError("Unexpected write error while writing Xbe file", false);
       goto cleanup;
     }
 
-    printf("OK\n");
+    LogPrintf(LL_INFO, "OK\n");
   }
 
-  // write Xbe certificate
-  {
-    printf("Xbe::Export: Writing Certificate...");
+cleanup:
 
-    fseek(XbeFile, m_Header.dwCertificateAddr - m_Header.dwBaseAddr, SEEK_SET);
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::Export: ERROR -> %s\n", GetError());
+  }
 
-    if (fwrite(&m_Certificate, sizeof(m_Certificate), 1, XbeFile) != 1) {
-      SetError("Unexpected write error while writing Xbe Certificate", false);
-      goto cleanup;
+  // if we came across an error, the file we were creating is deleted and the old one left alone
+  if (XbeFile >= 0) {
+    if (!FinishReplacement(XbeFile, szTemp, x_szXbeFilename, GetError() == 0) && GetError() == 0) {
+      SetError("Could not replace Xbe file", false);
+      LogPrintf(LL_ERROR, "Xbe::Export: ERROR -> %s\n", GetError());
     }
 
-    printf("OK\n");
+    XbeFile = -1;
   }
 
-  // write Xbe section headers
-  {
-    printf("Xbe::Export: Writing Section Headers...\n");
+  return;
+}
 
-    fseek(XbeFile, m_Header.dwSectionHeadersAddr - m_Header.dwBaseAddr, SEEK_SET);
+// export to memory buffer
+void Xbe::Export(std::vector<uint08> &x_Buffer, ExportDigest *x_Digest) {
+  if (GetError() != 0) return;
 
-    for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      printf("Xbe::Export: Writing Section Header 0x%.04X...", v);
+  ExportPlan Plan;
 
-      if (fwrite(&m_SectionHeader[v], sizeof(*m_SectionHeader), 1, XbeFile) != 1) {
-        sprintf(szBuffer, "Unexpected write error while writing Xbe Section %d (%Xh)", v, v);
-        SetError(szBuffer, false);
-        goto cleanup;
-      }
+  LogPrintf(LL_INFO, "Xbe::Export: Planning Layout...");
 
-      printf("OK\n");
-    }
+  PlanExport(Plan, x_Digest);
+
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    return;
   }
 
-  // write Xbe sections
-  {
-    printf("Xbe::Export: Writing Sections...\n");
+  LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
 
-    for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      printf("Xbe::Export: Writing Section 0x%.04X (%s)...", v, m_szSectionName[v]);
+  LogPrintf(LL_INFO, "Xbe::Export: Writing Xbe image...");
 
-      uint32 RawSize = m_SectionHeader[v].dwSizeofRaw;
-      uint32 RawAddr = m_SectionHeader[v].dwRawAddr;
+  Plan.Write(x_Buffer);
 
-      fseek(XbeFile, RawAddr, SEEK_SET);
+  LogPrintf(LL_INFO, "OK\n");
+}
 
-      if (RawSize == 0) {
-        printf("OK\n");
-        continue;
-      }
+// export to an open file descriptor
+void Xbe::ExportStream(int x_fd, ExportDigest *x_Digest) {
+  if (GetError() != 0) return;
 
-      if (fwrite(m_bzSection[v], RawSize, 1, XbeFile) != 1) {
-        sprintf(szBuffer, "Unexpected write error while writing Xbe Section %d (%Xh) (%s)", v, v, m_szSectionName[v]);
-        SetError(szBuffer, false);
-        goto cleanup;
-      }
+  ExportPlan Plan;
 
-      printf("OK\n");
-    }
-  }
+  LogPrintf(LL_INFO, "Xbe::ExportStream: Planning Layout...");
 
-  // zero pad
-  {
-    printf("Xbe::Export: Writing Zero Padding...");
+  PlanExport(Plan, x_Digest);
 
-    fpos_t pos;
+  if (GetError() != 0) {
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    return;
+  }
 
-    uint32 remaining = 0;
+  LogPrintf(LL_INFO, "OK (%d extents, %d bytes)\n", Plan.GetExtents(), Plan.GetSize());
 
-    fgetpos(XbeFile, &pos);
+  // nothing may be written before the whole layout is known, as there is no seeking back
+  LogPrintf(LL_INFO, "Xbe::ExportStream: Streaming Xbe file...");
 
-    remaining = (uint32)(0x1000 - ftell(XbeFile) % 0x1000);
+  if (!Plan.Stream(x_fd)) {
+    SetError("Unexpected write error while streaming Xbe file", false);
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::ExportStream: ERROR -> %s\n", GetError());
+    return;
+  }
 
-    // write remaining bytes
-    {
-      char *szBuffer = new char[remaining];
+  LogPrintf(LL_INFO, "OK\n");
+}
 
-      for (uint32 v = 0; v < remaining; v++) szBuffer[v] = 0;
+// lay out everything Export writes, in file order and with no overlapping writes
+void Xbe::PlanExport(ExportPlan &x_Plan, ExportDigest *x_Digest) {
+  // the signature covers everything in the headers past itself
+  if (x_Digest != nullptr) {
+    x_Digest->SetHeader(sizeof(m_Header.dwMagic) + sizeof(m_Header.pbDigitalSignature), m_Header.dwSizeofHeaders);
 
-      fwrite(szBuffer, remaining, 1, XbeFile);
+    x_Plan.SetDigest(x_Digest);
+  }
 
-      delete[] szBuffer;
-    }
+  // image header and extra header bytes
+  x_Plan.Add(0, &m_Header, sizeof(m_Header));
 
-    printf("OK\n");
-  }
+  if (m_Header.dwSizeofHeaders > sizeof(m_Header))
+    x_Plan.Add(sizeof(m_Header), m_HeaderEx, m_Header.dwSizeofHeaders - sizeof(m_Header));
 
-cleanup:
+  // the certificate and section headers take precedence over their copies in the extra header bytes
+  x_Plan.Add(m_Header.dwCertificateAddr - m_Header.dwBaseAddr, &m_Certificate, sizeof(m_Certificate));
 
-  // if we came across an error, delete the file we were creating
-  if (GetError() != 0) {
-    remove(x_szXbeFilename);
-    printf("FAILED!\n");
-    printf("Xbe::Export: ERROR -> %s\n", GetError());
-  }
+  x_Plan.Add(m_Header.dwSectionHeadersAddr - m_Header.dwBaseAddr, m_SectionHeader,
+             m_Header.dwSections * sizeof(*m_SectionHeader));
 
-  if (XbeFile != NULL) {
-    fclose(XbeFile);
-    XbeFile = NULL;
-  }
+  // sections, whatever of them is unmodified in the mapping is copied from the file
+  for (uint32 v = 0; v < m_Header.dwSections; v++)
+    x_Plan.Add(m_SectionHeader[v].dwRawAddr, GetSection(v), m_SectionHeader[v].dwSizeofRaw, m_File.get());
 
-  return;
+  // zero pad to a whole page (a packed file ends with its last section)
+  if (!(m_dwLayout & XL_PACK_FILE)) x_Plan.Extend(RoundUp(x_Plan.GetSize(), 0x1000));
 }
 
 // constructor initialization
@@ -995,6 +1450,19 @@ void Xbe::ConstructorInit() {
   m_XAPILibraryVersion = 0;
   m_TLS = 0;
   m_bzSection = 0;
+  m_pImage = 0;
+  m_dwImageSize = 0;
+  m_dwLayout = XL_DEFAULT;
+  m_dwPeImageBase = 0;
+  m_LazyFile = 0;
+}
+
+// is this buffer part of the in-memory image (and therefore not ours to free)?
+bool Xbe::IsImageBuffer(const void *x_pBuffer) const {
+  const uint08 *p = (const uint08 *)x_pBuffer;
+
+  // the end is included so that zero sized sections at the very end of the image are covered
+  return m_pImage != 0 && p >= m_pImage && p <= m_pImage + m_dwImageSize;
 }
 
 // returns xbe timestamp date as string (reuses ctime buffer)
@@ -1216,7 +1684,7 @@ void Xbe::DumpInformation(FILE *x_file) {
       fprintf(x_file, "\n");
     } else {
       for (uint32 v = 0; v < m_Header.dwLibraryVersions; v++) {
-        char tmp[9];
+        char tmp[9] = {0};
 
         for (uint32 c = 0; c < 8; c++) tmp[c] = m_LibraryVersion[v].szName[c];
 
@@ -1273,6 +1741,113 @@ void Xbe::DumpInformation(FILE *x_file) {
   }
 }
 
+// preload only the sections an access profile touches
+uint32 Xbe::ApplyPreloadProfile(const char *x_szFilename) {
+  char szLine[260];
+
+  uint32 dwEntries = 0;
+  uint32 dwIgnored = 0;
+
+  std::vector<uint08> Touched(m_Header.dwSections);
+
+  LogPrintf(LL_INFO, "Xbe::ApplyPreloadProfile: Reading Profile...");
+
+  FILE *ProfileFile = fopen(x_szFilename, "rt");
+
+  if (ProfileFile == 0) {
+    SetError("Could not open profile file", true);
+    LogPrintf(LL_ERROR, "FAILED!\n");
+    LogPrintf(LL_ERROR, "Xbe::ApplyPreloadProfile: ERROR -> %s\n", GetError());
+    return 0;
+  }
+
+  while (fgets(szLine, sizeof(szLine), ProfileFile) != 0) {
+    char *szEntry = szLine;
+
+    // strip comments and surrounding white space
+    {
+      char *szComment = strchr(szEntry, '#');
+
+      if (szComment != 0) *szComment = '\0';
+
+      while (isspace((unsigned char)*szEntry)) szEntry++;
+
+      size_t len = strlen(szEntry);
+
+      while (len > 0 && isspace((unsigned char)szEntry[len - 1])) szEntry[--len] = '\0';
+
+      if (len == 0) continue;
+    }
+
+    dwEntries++;
+
+    // a section name, or else an address (names such as "D3D" would read as hex as well)
+    sint32 s = -1;
+
+    for (uint32 v = 0; v < m_Header.dwSections && s < 0; v++)
+      if (strcmp(m_szSectionName[v], szEntry) == 0) s = v;
+
+    if (s < 0) {
+      char *szEnd;
+
+      unsigned long dwAddr = strtoul(szEntry, &szEnd, 16);
+
+      if (*szEnd == '\0') s = FindSection((uint32)dwAddr);
+    }
+
+    if (s < 0) {
+      dwIgnored++;
+      continue;
+    }
+
+    Touched[s] = 1;
+  }
+
+  fclose(ProfileFile);
+
+  LogPrintf(LL_INFO, "OK (%d Entries, %d Outside Every Section)\n", dwEntries, dwIgnored);
+
+  // the entry point, the kernel thunks and the TLS directory are needed before anything can be loaded on demand
+  {
+    uint32 dwRequired[] = {m_Header.dwEntryAddr ^ XOR_EP_RETAIL, m_Header.dwEntryAddr ^ XOR_EP_DEBUG,
+                           m_Header.dwKernelImageThunkAddr ^ XOR_KT_RETAIL,
+                           m_Header.dwKernelImageThunkAddr ^ XOR_KT_DEBUG, m_Header.dwTLSAddr,
+                           m_TLS != 0 ? m_TLS->dwDataStartAddr : 0};
+
+    for (uint32 dwAddr : dwRequired) {
+      sint32 s = dwAddr != 0 ? FindSection(dwAddr) : -1;
+
+      if (s >= 0) Touched[s] = 1;
+    }
+  }
+
+  uint32 dwPreloaded = 0;
+  uint32 dwDeferredRaw = 0;
+  uint32 dwDeferredVirtual = 0;
+
+  for (uint32 v = 0; v < m_Header.dwSections; v++) {
+    if (Touched[v]) {
+      m_SectionHeader[v].dwFlags.bPreload = true;
+      dwPreloaded++;
+      continue;
+    }
+
+    if (m_SectionHeader[v].dwFlags.bPreload) {
+      LogPrintf(LL_VERBOSE, "Xbe::ApplyPreloadProfile: Deferring Section %.04X (%s)\n", v, m_szSectionName[v]);
+
+      dwDeferredRaw += m_SectionHeader[v].dwSizeofRaw;
+      dwDeferredVirtual += m_SectionHeader[v].dwVirtualSize;
+    }
+
+    m_SectionHeader[v].dwFlags.bPreload = false;
+  }
+
+  LogPrintf(LL_INFO, "Xbe::ApplyPreloadProfile: %d of %d Sections Preloaded, %d Bytes Deferred (%d In Memory)\n",
+            dwPreloaded, m_Header.dwSections, dwDeferredRaw, dwDeferredVirtual);
+
+  return dwDeferredRaw;
+}
+
 // import logo bitmap from raw monochrome data
 void Xbe::ImportLogoBitmap(const uint08 x_Gray[100 * 17]) {
   char *LogoBuffer = new char[4 * 1024];
@@ -1383,18 +1958,347 @@ uint08 *Xbe::GetAddr(uint32 x_dwVirtualAddress) {
 
   // offset into some random section
   {
-    for (uint32 v = 0; v < m_Header.dwSections; v++) {
-      uint32 VirtAddr = m_SectionHeader[v].dwVirtualAddr;
-      uint32 VirtSize = m_SectionHeader[v].dwVirtualSize;
+    sint32 s = FindSection(x_dwVirtualAddress);
 
-      if ((x_dwVirtualAddress >= VirtAddr) && (x_dwVirtualAddress < (VirtAddr + VirtSize)))
-        return &m_bzSection[v][x_dwVirtualAddress - VirtAddr];
+    if (s >= 0) {
+      uint08 *bzSection = GetSection(s);
+
+      return bzSection != 0 ? &bzSection[x_dwVirtualAddress - m_SectionHeader[s].dwVirtualAddr] : 0;
     }
   }
 
   return 0;
 }
 
+// section containing a virtual address, or -1 if there is none
+sint32 Xbe::FindSection(uint32 x_dwVirtualAddress) const {
+  if (m_SectionIndex.IsBuilt()) return m_SectionIndex.Find(x_dwVirtualAddress);
+
+  for (uint32 v = 0; v < m_Header.dwSections; v++) {
+    uint32 VirtAddr = m_SectionHeader[v].dwVirtualAddr;
+    uint32 VirtSize = m_SectionHeader[v].dwVirtualSize;
+
+    if ((x_dwVirtualAddress >= VirtAddr) && (x_dwVirtualAddress < (VirtAddr + VirtSize))) return v;
+  }
+
+  return -1;
+}
+
+// raw section data at a PE relative virtual address, for applying relocations
+Relocation::Target Xbe::RelocationTarget(void *x_pContext, uint32 x_dwRVA) {
+  Xbe *xbe = (Xbe *)x_pContext;
+
+  uint32 dwAddr = xbe->MoveRVA(x_dwRVA) + xbe->m_Header.dwPeBaseAddr;
+
+  sint32 s = xbe->FindSection(dwAddr);
+
+  if (s < 0) return {0, 0};
+
+  // only the raw data exists, what lies past it is zero filled when loading
+  uint32 dwOffs = dwAddr - xbe->m_SectionHeader[s].dwVirtualAddr;
+  uint32 dwSize = xbe->m_SectionHeader[s].dwSizeofRaw;
+
+  uint08 *bzSection = xbe->GetSection(s);
+
+  if (bzSection == 0 || dwOffs >= dwSize) return {0, 0};
+
+  return {&bzSection[dwOffs], dwSize - dwOffs};
+}
+
+// SHA-1 of every section the way its digest is taken
+bool Xbe::CalcSectionDigests(uint08 *x_pDigests) {
+  std::vector<Sha1Message> Messages;
+
+  if (!GetSectionMessages(Messages, x_pDigests)) return false;
+
+  // biggest first, so that no thread is left with a long section once the others are done; each thread
+  // takes as many sections as are hashed side by side
+  std::sort(Messages.begin(), Messages.end(),
+            [](const Sha1Message &x_A, const Sha1Message &x_B) { return x_A.dwSize > x_B.dwSize; });
+
+  ThreadPool::Get().ParallelFor((uint32)Messages.size(), Sha1Width(), [&](uint32 x_dwBegin, uint32 x_dwEnd) {
+    Sha1Many(&Messages[x_dwBegin], x_dwEnd - x_dwBegin);
+  });
+
+  return true;
+}
+
+// append the message behind every section's digest to x_Messages
+bool Xbe::GetSectionMessages(std::vector<Sha1Message> &x_Messages, uint08 *x_pDigests) {
+  for (uint32 v = 0; v < m_Header.dwSections; v++) {
+    uint08 *bzSection = GetSection(v);
+
+    if (bzSection == 0 && m_SectionHeader[v].dwSizeofRaw != 0) return false;
+
+    x_Messages.push_back({(const uint08 *)&m_SectionHeader[v].dwSizeofRaw, 4, bzSection,
+                          m_SectionHeader[v].dwSizeofRaw, &x_pDigests[v * SHA1_DIGEST_SIZE]});
+  }
+
+  return true;
+}
+
+// compare digests GetSectionMessages had worked out with the ones the section headers hold
+uint32 Xbe::CheckSectionDigests(const uint08 *x_pDigests, std::vector<uint32> &x_Failed) const {
+  x_Failed.clear();
+
+  for (uint32 v = 0; v < m_Header.dwSections; v++)
+    if (memcmp(&x_pDigests[v * SHA1_DIGEST_SIZE], m_SectionHeader[v].bzSectionDigest, SHA1_DIGEST_SIZE) != 0)
+      x_Failed.push_back(v);
+
+  return (uint32)x_Failed.size();
+}
+
+// name of a section for messages, or its index if it has none
+std::string Xbe::GetSectionLabel(uint32 x_dwSection) const {
+  if (m_szSectionName != 0 && m_szSectionName[x_dwSection][0] != '\0') return m_szSectionName[x_dwSection];
+
+  char szLabel[16];
+
+  snprintf(szLabel, sizeof(szLabel), "#%u", x_dwSection);
+
+  return szLabel;
+}
+
+// relocated value of an address the Exe was linked with, once sections have moved
+uint32 Xbe::RelocationValue(void *x_pContext, uint32 x_dwValue) {
+  Xbe *xbe = (Xbe *)x_pContext;
+
+  return xbe->MoveRVA(x_dwValue - xbe->m_dwPeImageBase) + xbe->m_Header.dwPeBaseAddr;
+}
+
+// move the Exe's data sections down to share boundary pages, returns the bytes of memory saved
+uint32 Xbe::ShareSectionPages(class Exe *x_Exe) {
+  uint32 dwSections = x_Exe->m_Header.m_sections;
+
+  m_dwPeImageBase = x_Exe->m_OptionalHeader.m_image_base;
+
+  m_SectionMove.resize(dwSections);
+
+  // relative calls and jumps between executable sections are never relocated, so those all keep the same
+  // distance to each other, anything else only moves by a multiple of XBE_SHARED_ALIGN to keep its alignment
+  bool bCode = false;
+  uint32 dwCodeDelta = 0;
+  uint32 dwCursor = 0;
+  bool bMoved = false;
+
+  for (uint32 v = 0; v < dwSections; v++) {
+    const Exe::SectionHeader &Section = x_Exe->m_SectionHeader[v];
+
+    // what the section really takes, which never reaches past the next one
+    uint32 dwSize = RoundUp(Section.m_virtual_size != 0 ? Section.m_virtual_size : Section.m_sizeof_raw, 4);
+
+    if (dwSize == 0) dwSize = 4;
+
+    if (v < dwSections - 1 && dwSize > x_Exe->m_SectionHeader[v + 1].m_virtual_addr - Section.m_virtual_addr)
+      dwSize = x_Exe->m_SectionHeader[v + 1].m_virtual_addr - Section.m_virtual_addr;
+
+    bool bExecutable =
+        (Section.m_characteristics & IMAGE_SCN_MEM_EXECUTE) || (Section.m_characteristics & IMAGE_SCN_CNT_CODE);
+
+    uint32 dwNew = Section.m_virtual_addr;
+
+    if (v > 0) {
+      if (bExecutable && bCode)
+        dwNew = Section.m_virtual_addr + dwCodeDelta;
+      else
+        dwNew = dwCursor + ((Section.m_virtual_addr - dwCursor) & (XBE_SHARED_ALIGN - 1));
+
+      // a section that ends right where code that keeps its distance starts moves along with that code, so
+      // that an address of its end still is the code's start (the code delta is a multiple of the alignment)
+      if (!bExecutable && bCode && v < dwSections - 1) {
+        const Exe::SectionHeader &Next = x_Exe->m_SectionHeader[v + 1];
+
+        bool bNextExecutable =
+            (Next.m_characteristics & IMAGE_SCN_MEM_EXECUTE) || (Next.m_characteristics & IMAGE_SCN_CNT_CODE);
+
+        if (bNextExecutable && Section.m_virtual_addr + dwSize == Next.m_virtual_addr &&
+            Section.m_virtual_addr + dwCodeDelta >= dwCursor)
+          dwNew = Section.m_virtual_addr + dwCodeDelta;
+      }
+
+      if (dwNew < dwCursor || dwNew > Section.m_virtual_addr) {
+        SetError("Sections cannot share pages without moving code apart", true);
+        return 0;
+      }
+    }
+
+    if (bExecutable && !bCode) {
+      bCode = true;
+      dwCodeDelta = dwNew - Section.m_virtual_addr;
+    }
+
+    if (dwNew != Section.m_virtual_addr) bMoved = true;
+
+    m_SectionMove[v] = {Section.m_virtual_addr, dwNew, dwSize};
+
+    dwCursor = dwNew + dwSize;
+  }
+
+  // every address into a moved section has to be fixed up
+  if (bMoved && x_Exe->m_OptionalHeader.m_image_data_directory[IMAGE_DIRECTORY_ENTRY_BASERELOC].m_size == 0) {
+    SetError("Sections cannot share pages without a relocation table", true);
+    return 0;
+  }
+
+  // pages a layout takes, where a page that ends one section and starts the next is only counted once
+  auto CountPages = [&](bool x_bMoved) {
+    uint32 dwPages = 0;
+    uint32 dwLastPage = 0;
+
+    for (uint32 v = 0; v < dwSections; v++) {
+      const SectionMove &Move = m_SectionMove[v];
+
+      uint32 dwStart = x_bMoved ? Move.dwNewRVA : Move.dwOldRVA;
+      uint32 dwEnd = dwStart + Move.dwSize;
+
+      // by default, sections reach up to the next one
+      if (!x_bMoved)
+        dwEnd = (v < dwSections - 1) ? m_SectionMove[v + 1].dwOldRVA
+                                     : Move.dwOldRVA + RoundUp(x_Exe->m_SectionHeader[v].m_virtual_size, 4);
+
+      uint32 dwFirst = dwStart & ~0xFFF;
+
+      if (v > 0 && dwFirst == dwLastPage) dwFirst += 0x1000;
+
+      if (RoundUp(dwEnd, 0x1000) > dwFirst) dwPages += (RoundUp(dwEnd, 0x1000) - dwFirst) / 0x1000;
+
+      dwLastPage = (dwEnd - 1) & ~0xFFF;
+    }
+
+    return dwPages;
+  };
+
+  return (CountPages(false) - CountPages(true)) * 0x1000;
+}
+
+// where a PE relative virtual address ended up once sections have moved
+uint32 Xbe::MoveRVA(uint32 x_dwRVA) const {
+  // the last section starting at or below the address (anything before the first one did not move)
+  auto Move = std::upper_bound(m_SectionMove.begin(), m_SectionMove.end(), x_dwRVA,
+                               [](uint32 x_dwAddr, const SectionMove &x_Move) { return x_dwAddr < x_Move.dwOldRVA; });
+
+  if (Move == m_SectionMove.begin()) return x_dwRVA;
+
+  --Move;
+
+  // the end of the section before (a bound of a table, say) belongs to that section
+  if (Move != m_SectionMove.begin() && x_dwRVA == Move->dwOldRVA &&
+      std::prev(Move)->dwOldRVA + std::prev(Move)->dwSize == x_dwRVA)
+    --Move;
+
+  return x_dwRVA - Move->dwOldRVA + Move->dwNewRVA;
+}
+
+// kernel thunk table address, decoded with whichever key puts it inside a section
+uint32 Xbe::GetKernelThunkAddr(bool &x_bRetail) {
+  uint32 dwRetail = m_Header.dwKernelImageThunkAddr ^ XOR_KT_RETAIL;
+  uint32 dwDebug = m_Header.dwKernelImageThunkAddr ^ XOR_KT_DEBUG;
+
+  x_bRetail = FindSection(dwRetail) >= 0;
+
+  if (x_bRetail) return dwRetail;
+
+  return FindSection(dwDebug) >= 0 ? dwDebug : 0;
+}
+
+// kernel exports the thunk table imports, by ordinal and in table order
+bool Xbe::GetKernelImports(std::vector<uint32> &x_Ordinals) {
+  bool bRetail;
+
+  uint32 dwAddr = GetKernelThunkAddr(bRetail);
+
+  x_Ordinals.clear();
+
+  // a thunk address of 0 (relative to the original image) means there are no imports at all
+  if ((m_Header.dwKernelImageThunkAddr ^ XOR_KT_RETAIL) == m_Header.dwPeBaseAddr ||
+      (m_Header.dwKernelImageThunkAddr ^ XOR_KT_DEBUG) == m_Header.dwPeBaseAddr)
+    return true;
+
+  if (dwAddr == 0) {
+    SetError("Kernel thunk table is outside of every section", false);
+    return false;
+  }
+
+  sint32 s = FindSection(dwAddr);
+
+  uint08 *bzSection = GetSection(s);
+
+  // reading it may already have said why
+  if (bzSection == 0) {
+    if (GetError() == 0) SetError("Could not read the section holding the kernel thunk table", false);
+    return false;
+  }
+
+  uint32 dwRaw = m_SectionHeader[s].dwSizeofRaw;
+  uint32 dwVirt = m_SectionHeader[s].dwVirtualSize;
+
+  for (uint32 dwOffs = dwAddr - m_SectionHeader[s].dwVirtualAddr;; dwOffs += 4) {
+    if (dwVirt - dwOffs < 4) {
+      SetError("Kernel thunk table runs past the end of its section", false);
+      return false;
+    }
+
+    // what lies past the raw data is zero filled when loading
+    uint32 dwThunk = 0;
+
+    if (dwOffs < dwRaw) memcpy(&dwThunk, &bzSection[dwOffs], dwRaw - dwOffs < 4 ? dwRaw - dwOffs : 4);
+
+    if (dwThunk == 0) break;
+
+    // before loading, every entry is an ordinal with the top bit set
+    if (!(dwThunk & 0x80000000)) {
+      SetError("Kernel thunk table holds an entry that is not an ordinal", false);
+      return false;
+    }
+
+    x_Ordinals.push_back(dwThunk & 0x7FFFFFFF);
+  }
+
+  return true;
+}
+
+// (re)build the section lookup index, once the section headers are final
+void Xbe::IndexSections() {
+  m_SectionIndex.Clear();
+
+  for (uint32 v = 0; v < m_Header.dwSections; v++)
+    m_SectionIndex.Add(v, m_SectionHeader[v].dwVirtualAddr, m_SectionHeader[v].dwVirtualSize);
+
+  // overlapping sections are left to the linear scan
+  m_SectionIndex.Build();
+}
+
+// return a section's data, reading it first if it was not loaded yet
+uint08 *Xbe::GetSection(uint32 x_dwSection) {
+  if (m_bzSection == 0) return 0;
+
+  if (m_bzSection[x_dwSection] == 0 && m_LazyFile != 0) LoadSection(x_dwSection);
+
+  return m_bzSection[x_dwSection];
+}
+
+// read a section that lazy loading left out
+bool Xbe::LoadSection(uint32 x_dwSection) {
+  char szBuffer[260];
+
+  uint32 RawSize = m_SectionHeader[x_dwSection].dwSizeofRaw;
+  uint32 RawAddr = m_SectionHeader[x_dwSection].dwRawAddr;
+
+  uint08 *bzSection = new uint08[RawSize];
+
+  if (RawSize != 0 && (fseek(m_LazyFile, RawAddr, SEEK_SET) != 0 || fread(bzSection, RawSize, 1, m_LazyFile) != 1)) {
+    delete[] bzSection;
+
+    sprintf(szBuffer, "Unexpected end of file while reading Xbe Section %d (%Xh)", x_dwSection, x_dwSection);
+    SetError(szBuffer, true);
+    return false;
+  }
+
+  m_bzSection[x_dwSection] = bzSection;
+
+  return true;
+}
+
 // return a modifiable pointer to logo bitmap data
 uint08 *Xbe::GetLogoBitmap(uint32 x_dwSize) {
   uint32 dwOffs = m_Header.dwLogoBitmapAddr - m_Header.dwBaseAddr;
@@ -36,22 +36,53 @@
 
 #include <stdio.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "Error.h"
+#include "MappedFile.h"
+#include "Relocation.h"
+#include "SectionIndex.h"
+
+// how an Exe is laid out when it is converted (flags, combined with |)
+enum XbeLayout {
+  XL_DEFAULT = 0,      // every section's raw data starts on a page of its own, room is left for any logo
+  XL_PACK_FILE = 1,    // raw data packed back to back, and only as much room as the logo needs
+  XL_SHARE_PAGES = 2,  // data sections moved down to share their boundary pages with their neighbours in memory
+};
+
+// sections moved to share pages keep their offset within a block of this many bytes, and with it whatever
+// alignment the linker gave the data in them (data aligned to more than this may end up misaligned)
+#define XBE_SHARED_ALIGN 0x40
 
 // Xbe (Xbox Executable) file object
 class Xbe : public Error {
  public:
-  // construct via Xbe file
-  Xbe(const char *x_szFilename);
+  // construct via Xbe file (by default the file is mapped and sections point into it)
+  Xbe(const char *x_szFilename, LoadMode x_Mode = LM_MAPPED);
+
+  // construct via Xbe image already in memory (the buffer stays the caller's and must outlive this object);
+  // headers and sections are parsed in place, so anything that changes this Xbe writes into the buffer
+  Xbe(uint08 *x_pImage, uint32 x_dwSize);
 
   // construct via Exe file object
-  Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail);
+  Xbe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout = XL_DEFAULT);
+
+  // construct via Exe file object that is given up, adopting its section buffers instead of copying them
+  Xbe(std::unique_ptr<class Exe> x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout = XL_DEFAULT);
 
   // deconstructor
   ~Xbe();
 
-  // export to Xbe file
-  void Export(const char *x_szXbeFilename);
+  // export to Xbe file (x_Digest, if given, digests the headers the signature covers as they are written)
+  void Export(const char *x_szXbeFilename, class ExportDigest *x_Digest = nullptr);
+
+  // export to memory buffer (replacing its contents)
+  void Export(std::vector<uint08> &x_Buffer, class ExportDigest *x_Digest = nullptr);
+
+  // export to an open file descriptor, written front to back so that pipes work
+  void ExportStream(int x_fd, class ExportDigest *x_Digest = nullptr);
 
   // dump Xbe information to text file
   void DumpInformation(FILE *x_file);
@@ -62,6 +93,11 @@ class Xbe : public Error {
   // export logo bitmap to raw monochrome data
   void ExportLogoBitmap(uint08 x_Gray[100 * 17]);
 
+  // preload only the sections an access profile touches (plus those the loader needs before any code runs),
+  // the profile lists section names and/or virtual addresses in hex, one per line (# starts a comment);
+  // returns the number of raw bytes that are no longer read at boot
+  uint32 ApplyPreloadProfile(const char *x_szFilename);
+
   // Xbe header
 #include "AlignPrefix1.h"
   struct Header {
@@ -224,10 +260,73 @@ class Xbe : public Error {
   // return a modifiable pointer inside this structure that corresponds to a virtual address
   uint08 *GetAddr(uint32 x_dwVirtualAddress);
 
+  // return a section's data, reading it first if it was not loaded yet
+  uint08 *GetSection(uint32 x_dwSection);
+
+  // kernel thunk table address, decoded with the retail or the debug key, whichever puts it inside a section
+  // (x_bRetail tells which), or 0 if neither does
+  uint32 GetKernelThunkAddr(bool &x_bRetail);
+
+  // kernel exports the thunk table imports, by ordinal and in table order, returns false (with a warning
+  // set) if the table cannot be read or holds something other than ordinals
+  bool GetKernelImports(std::vector<uint32> &x_Ordinals);
+
+  // SHA-1 of every section the way its digest is taken (raw size, then raw data), 20 bytes per section
+  // into x_pDigests, returns false if a section could not be read
+  bool CalcSectionDigests(uint08 *x_pDigests);
+
+  // append the message behind every section's digest to x_Messages, each to be digested into x_pDigests
+  // (20 bytes per section), for hashing along with other files' sections
+  bool GetSectionMessages(std::vector<struct Sha1Message> &x_Messages, uint08 *x_pDigests);
+
+  // compare digests GetSectionMessages had worked out with the ones the section headers hold, returns the
+  // number of sections whose digest differs and lists them in x_Failed
+  uint32 CheckSectionDigests(const uint08 *x_pDigests, std::vector<uint32> &x_Failed) const;
+
+  // name of a section for messages, or its index ("#0") if it has none
+  std::string GetSectionLabel(uint32 x_dwSection) const;
+
+  // mapping the sections may lie in (if the Xbe came from a file, or adopted an Exe's sections)
+  std::shared_ptr<MappedFile> GetFile() const { return m_File; }
+
  private:
   // constructor initialization
   void ConstructorInit();
 
+  // parse an Xbe image that is already in memory, pointing into it instead of copying
+  void ParseImage(uint08 *x_pImage, uint32 x_dwSize);
+
+  // convert an Exe, taking over its section buffers (relocating them in place) if x_bAdopt is set
+  void ConvertExe(class Exe *x_Exe, const char *x_szTitle, bool x_bRetail, uint32 x_dwLayout, bool x_bAdopt);
+
+  // (re)build the section lookup index, once the section headers are final
+  void IndexSections();
+
+  // section containing a virtual address, or -1 if there is none
+  sint32 FindSection(uint32 x_dwVirtualAddress) const;
+
+  // raw section data at a PE relative virtual address, for applying relocations (x_pContext is the Xbe)
+  static Relocation::Target RelocationTarget(void *x_pContext, uint32 x_dwRVA);
+
+  // relocated value of an address the Exe was linked with, once sections have moved (x_pContext is the Xbe)
+  static uint32 RelocationValue(void *x_pContext, uint32 x_dwValue);
+
+  // move the Exe's data sections down to share boundary pages, returns the bytes of memory saved
+  uint32 ShareSectionPages(class Exe *x_Exe);
+
+  // where a PE relative virtual address ended up once sections have moved
+  uint32 MoveRVA(uint32 x_dwRVA) const;
+
+  // read a section that lazy loading left out
+  bool LoadSection(uint32 x_dwSection);
+
+  // is this buffer part of the in-memory image (and therefore not ours to free)?
+  bool IsImageBuffer(const void *x_pBuffer) const;
+
+  // lay out everything Export writes, in file order and with no overlapping writes, and have x_Digest (if
+  // any) digest it on the way out
+  void PlanExport(class ExportPlan &x_Plan, class ExportDigest *x_Digest);
+
   // return a modifiable pointer to logo bitmap data
   uint08 *GetLogoBitmap(uint32 x_dwSize);
 
@@ -246,6 +345,37 @@ class Xbe : public Error {
       uint32 Data : 4;
     } m_Sixteen;
   };
+
+  // in-memory image that headers and sections may point into
+  uint08 *m_pImage;
+  uint32 m_dwImageSize;
+
+  // mapping backing m_pImage (if it came from a file)
+  std::shared_ptr<MappedFile> m_File;
+
+  // contents backing m_pImage (if they came from a file that could not seek)
+  std::vector<uint08> m_Stream;
+
+  // layout the Xbe was converted with (XL_DEFAULT if it was read from a file)
+  uint32 m_dwLayout;
+
+  // where each of the Exe's sections moved to, in section order (empty unless pages are shared)
+  struct SectionMove {
+    uint32 dwOldRVA;
+    uint32 dwNewRVA;
+    uint32 dwSize;
+  };
+
+  std::vector<SectionMove> m_SectionMove;
+
+  // image base the Exe was linked with (only needed once sections have moved)
+  uint32 m_dwPeImageBase;
+
+  // file that sections not yet read come from (lazy loading only)
+  FILE *m_LazyFile;
+
+  // finds the section holding a virtual address
+  SectionIndex m_SectionIndex;
 };
 
 // debug/retail XOR keys
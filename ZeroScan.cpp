@@ -0,0 +1,97 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "ZeroScan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEROSCAN_X86
+#endif
+
+// a byte (well, a word) at a time
+static uint32 TrimZerosScalar(const uint08 *x_pData, uint32 x_dwSize) {
+  while (x_dwSize >= 8) {
+    uint64_t qw;
+
+    memcpy(&qw, &x_pData[x_dwSize - 8], 8);
+
+    if (qw != 0) break;
+
+    x_dwSize -= 8;
+  }
+
+  while (x_dwSize > 0 && x_pData[x_dwSize - 1] == 0) x_dwSize--;
+
+  return x_dwSize;
+}
+
+#ifdef ZEROSCAN_X86
+// 16 bytes at a time, 64 while everything is zero
+__attribute__((target("sse2"))) static uint32 TrimZerosSSE2(const uint08 *x_pData, uint32 x_dwSize) {
+  const __m128i zero = _mm_setzero_si128();
+
+  while (x_dwSize >= 64) {
+    const __m128i *p = (const __m128i *)&x_pData[x_dwSize - 64];
+
+    __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p + 0), _mm_loadu_si128(p + 1)),
+                               _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) break;
+
+    x_dwSize -= 64;
+  }
+
+  while (x_dwSize >= 16) {
+    uint32 mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&x_pData[x_dwSize - 16]), zero));
+
+    // the highest set bit is the last non-zero byte
+    if (mask & 0xFFFF) return x_dwSize - 16 + (32 - __builtin_clz(mask & 0xFFFF));
+
+    x_dwSize -= 16;
+  }
+
+  return TrimZerosScalar(x_pData, x_dwSize);
+}
+
+// 32 bytes at a time, 128 while everything is zero
+__attribute__((target("avx2"))) static uint32 TrimZerosAVX2(const uint08 *x_pData, uint32 x_dwSize) {
+  const __m256i zero = _mm256_setzero_si256();
+
+  while (x_dwSize >= 128) {
+    const __m256i *p = (const __m256i *)&x_pData[x_dwSize - 128];
+
+    __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(p + 0), _mm256_loadu_si256(p + 1)),
+                                  _mm256_or_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+
+    if (!_mm256_testz_si256(any, any)) break;
+
+    x_dwSize -= 128;
+  }
+
+  while (x_dwSize >= 32) {
+    uint32 mask =
+        ~(uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&x_pData[x_dwSize - 32]), zero));
+
+    // the highest set bit is the last non-zero byte
+    if (mask != 0) return x_dwSize - 32 + (32 - __builtin_clz(mask));
+
+    x_dwSize -= 32;
+  }
+
+  return TrimZerosSSE2(x_pData, x_dwSize);
+}
+#endif
+
+// length of x_pData[0, x_dwSize) once its trailing zero bytes are cut off
+uint32 TrimZeros(const uint08 *x_pData, uint32 x_dwSize) {
+#ifdef ZEROSCAN_X86
+  static const bool bAVX2 = __builtin_cpu_supports("avx2");
+
+  if (bAVX2) return TrimZerosAVX2(x_pData, x_dwSize);
+
+  return TrimZerosSSE2(x_pData, x_dwSize);
+#else
+  return TrimZerosScalar(x_pData, x_dwSize);
+#endif
+}
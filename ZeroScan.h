@@ -0,0 +1,12 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef ZEROSCAN_H
+#define ZEROSCAN_H
+
+#include "Cxbx.h"
+
+// length of x_pData[0, x_dwSize) once its trailing zero bytes are cut off (0 if it is all
+// zeros), scanning backwards with the widest vector instructions the processor supports
+uint32 TrimZeros(const uint08 *x_pData, uint32 x_dwSize);
+
+#endif
@@ -0,0 +1,192 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "ConvertCache.h"
+#include "Test.h"
+
+static void WriteFile(const std::string &x_szPath, const std::string &x_Contents) {
+  FILE *File = fopen(x_szPath.c_str(), "wb");
+
+  if (File == nullptr) return;
+
+  fwrite(x_Contents.data(), 1, x_Contents.size(), File);
+  fclose(File);
+}
+
+static std::string ReadFile(const std::string &x_szPath) {
+  std::string Contents;
+
+  FILE *File = fopen(x_szPath.c_str(), "rb");
+
+  if (File == nullptr) return Contents;
+
+  char Buffer[4096];
+  size_t Size;
+
+  while ((Size = fread(Buffer, 1, sizeof(Buffer), File)) > 0) Contents.append(Buffer, Size);
+
+  fclose(File);
+
+  return Contents;
+}
+
+static nlink_t GetLinks(const std::string &x_szPath) {
+  struct stat st;
+
+  return stat(x_szPath.c_str(), &st) == 0 ? st.st_nlink : 0;
+}
+
+static int RemoveEntry(const char *x_szPath, const struct stat *, int, struct FTW *) { return remove(x_szPath); }
+
+// what a converter does: take the output from the cache, or else convert (here, write x_Output) and store it;
+// returns whether it was a hit
+static bool Convert(const std::string &x_szDir, const char *x_szMode, const std::string &x_szInput,
+                    const std::string &x_szOutput, const std::string &x_Output, uint64_t x_qwLimit = 1 << 20,
+                    bool x_bLink = false) {
+  ConvertCache Cache(x_szDir.c_str(), "test", x_qwLimit, x_bLink);
+
+  Cache.AddOption("MODE", x_szMode);
+
+  CHECK(Cache.AddFile(x_szInput.c_str()));
+
+  if (Cache.Fetch(x_szOutput.c_str())) return true;
+
+  WriteFile(x_szOutput, x_Output);
+
+  CHECK(Cache.Store(x_szOutput.c_str()));
+  CHECK(Cache.GetError() == nullptr);
+
+  return false;
+}
+
+static void TestParseLimit() {
+  uint64_t qwLimit = 0;
+
+  CHECK(ConvertCache::ParseLimit("", qwLimit) && qwLimit == (uint64_t)CONVERTCACHE_DEFAULT_MB << 20);
+  CHECK(ConvertCache::ParseLimit("10", qwLimit) && qwLimit == 10 << 20);
+  CHECK(ConvertCache::ParseLimit("0", qwLimit) && qwLimit == 0);
+  CHECK(!ConvertCache::ParseLimit("ten", qwLimit));
+  CHECK(!ConvertCache::ParseLimit("10MB", qwLimit));
+  CHECK(!ConvertCache::ParseLimit("-1", qwLimit));
+  CHECK(!ConvertCache::ParseLimit("99999999999999999999", qwLimit));
+}
+
+// hits for the same input and options only, always as copies unless links are asked for
+static void TestHits(const std::string &x_szTemp) {
+  std::string szDir = x_szTemp + "/cache";
+  std::string szInput = x_szTemp + "/input.exe";
+  std::string szOutput = x_szTemp + "/output.xbe";
+  std::string Output(5000, 'x');
+
+  WriteFile(szInput, "input");
+
+  CHECK(!Convert(szDir, "retail", szInput, szOutput, Output));
+  CHECK(GetLinks(szOutput) == 1);
+
+  unlink(szOutput.c_str());
+
+  CHECK(Convert(szDir, "retail", szInput, szOutput, "not converted"));
+  CHECK(ReadFile(szOutput) == Output);
+  CHECK(GetLinks(szOutput) == 1);
+
+  // a hit replaces whatever was there
+  WriteFile(szOutput, "an older output");
+
+  CHECK(Convert(szDir, "retail", szInput, szOutput, "not converted"));
+  CHECK(ReadFile(szOutput) == Output);
+
+  // another option, or another input, is another output
+  CHECK(!Convert(szDir, "debug", szInput, szOutput, "debug output"));
+  CHECK(ReadFile(szOutput) == "debug output");
+
+  WriteFile(szInput, "changed input");
+
+  CHECK(!Convert(szDir, "retail", szInput, szOutput, "changed output"));
+  CHECK(Convert(szDir, "retail", szInput, szOutput, "not converted"));
+  CHECK(ReadFile(szOutput) == "changed output");
+
+  // an output that is not a regular file is left alone
+  std::string szDirectory = x_szTemp + "/directory.xbe";
+
+  mkdir(szDirectory.c_str(), 0755);
+
+  {
+    ConvertCache Cache(szDir.c_str(), "test", 1 << 20);
+
+    Cache.AddOption("MODE", "retail");
+    Cache.AddFile(szInput.c_str());
+
+    CHECK(!Cache.Fetch(szDirectory.c_str()));
+  }
+
+  struct stat st;
+
+  CHECK(stat(szDirectory.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+
+  // with links allowed, the output may be the cached copy itself (unless the filesystem shares blocks instead),
+  // and writing to it then gives the cached copy away as changed
+  CHECK(Convert(szDir, "retail", szInput, szOutput, "not converted", 1 << 20, true));
+  CHECK(ReadFile(szOutput) == "changed output");
+
+  if (GetLinks(szOutput) > 1) {
+    int fd = open(szOutput.c_str(), O_WRONLY | O_APPEND);
+
+    CHECK(fd >= 0 && write(fd, "!", 1) == 1);
+
+    if (fd >= 0) close(fd);
+
+    unlink(szOutput.c_str());
+
+    CHECK(!Convert(szDir, "retail", szInput, szOutput, "converted again"));
+    CHECK(ReadFile(szOutput) == "converted again");
+  }
+}
+
+// the least recently used outputs go once the cache is over its limit
+static void TestEviction(const std::string &x_szTemp) {
+  std::string szDir = x_szTemp + "/small";
+  std::string szInput = x_szTemp + "/small.exe";
+  std::string szOutput = x_szTemp + "/small.xbe";
+
+  WriteFile(szInput, "input");
+
+  // room for one output and a half
+  const uint64_t qwLimit = 1500;
+
+  CHECK(!Convert(szDir, "a", szInput, szOutput, std::string(1000, 'a'), qwLimit));
+  CHECK(Convert(szDir, "a", szInput, szOutput, "", qwLimit));
+  CHECK(!Convert(szDir, "b", szInput, szOutput, std::string(1000, 'b'), qwLimit));
+  CHECK(!Convert(szDir, "a", szInput, szOutput, std::string(1000, 'a'), qwLimit));
+  CHECK(!Convert(szDir, "b", szInput, szOutput, std::string(1000, 'b'), qwLimit));
+  CHECK(Convert(szDir, "b", szInput, szOutput, "", qwLimit));
+  CHECK(ReadFile(szOutput) == std::string(1000, 'b'));
+
+  // an output bigger than the whole cache is still kept, on its own
+  CHECK(!Convert(szDir, "c", szInput, szOutput, std::string(2000, 'c'), qwLimit));
+  CHECK(Convert(szDir, "c", szInput, szOutput, "", qwLimit));
+  CHECK(!Convert(szDir, "b", szInput, szOutput, std::string(1000, 'b'), qwLimit));
+}
+
+void TestConvertCache() {
+  char szTemp[] = "/tmp/convertcache-test.XXXXXX";
+
+  if (mkdtemp(szTemp) == nullptr) {
+    printf("ConvertCache: could not create a temporary directory\n");
+    g_TestFailures++;
+    return;
+  }
+
+  TestParseLimit();
+  TestHits(szTemp);
+  TestEviction(szTemp);
+
+  nftw(szTemp, RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
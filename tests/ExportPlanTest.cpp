@@ -0,0 +1,228 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ExportPlan.h"
+#include "MappedFile.h"
+#include "Test.h"
+
+// an extent as it is added, and the buffer it comes from
+struct TestExtent {
+  uint32 dwOffset;
+  uint32 dwSize;
+  uint08 bFill;
+};
+
+// the file a list of extents should produce: each one written over the ones before it, zeros in between
+static std::vector<uint08> Expected(const std::vector<TestExtent> &x_Extents, uint32 x_dwSize) {
+  std::vector<uint08> Buffer(x_dwSize, 0);
+
+  for (const TestExtent &e : x_Extents) memset(&Buffer[e.dwOffset], e.bFill, e.dwSize);
+
+  return Buffer;
+}
+
+// everything in a file, read back from the start
+static std::vector<uint08> ReadBack(int x_fd) {
+  std::vector<uint08> Buffer;
+  uint08 Chunk[4096];
+  ssize_t Got;
+  off_t Pos = 0;
+
+  while ((Got = pread(x_fd, Chunk, sizeof(Chunk), Pos)) > 0) {
+    Buffer.insert(Buffer.end(), Chunk, Chunk + Got);
+    Pos += Got;
+  }
+
+  return Buffer;
+}
+
+// a new, empty temporary file (already unlinked), or -1
+static int TempFile() {
+  char szTemp[] = "/tmp/exportplan-test.XXXXXX";
+
+  int fd = mkstemp(szTemp);
+
+  if (fd >= 0) unlink(szTemp);
+
+  return fd;
+}
+
+// the file each way of writing a plan produces, and their digests, all have to agree with x_Expected
+static void CheckWriters(ExportPlan &x_Plan, const std::vector<uint08> &x_Expected) {
+  std::vector<uint08> Buffer;
+  uint08 Digests[3][SHA1_DIGEST_SIZE];
+
+  ExportDigest Memory(true);
+  x_Plan.SetDigest(&Memory);
+  x_Plan.Write(Buffer);
+  x_Plan.SetDigest(nullptr);
+
+  memcpy(Digests[0], Memory.GetFile(), SHA1_DIGEST_SIZE);
+
+  CHECK(Buffer == x_Expected);
+
+  int fd = TempFile();
+
+  CHECK(fd >= 0);
+
+  if (fd < 0) return;
+
+  ExportDigest Positioned(true);
+  x_Plan.SetDigest(&Positioned);
+  CHECK(x_Plan.Write(fd));
+  x_Plan.SetDigest(nullptr);
+
+  memcpy(Digests[1], Positioned.GetFile(), SHA1_DIGEST_SIZE);
+
+  CHECK(ReadBack(fd) == x_Expected);
+
+  close(fd);
+
+  fd = TempFile();
+
+  CHECK(fd >= 0);
+
+  if (fd < 0) return;
+
+  ExportDigest Streamed(true);
+  x_Plan.SetDigest(&Streamed);
+  CHECK(x_Plan.Stream(fd));
+  x_Plan.SetDigest(nullptr);
+
+  memcpy(Digests[2], Streamed.GetFile(), SHA1_DIGEST_SIZE);
+
+  CHECK(ReadBack(fd) == x_Expected);
+
+  close(fd);
+
+  uint08 Digest[SHA1_DIGEST_SIZE];
+
+  Sha1 Whole;
+  Whole.Update(x_Expected.data(), (uint32)x_Expected.size());
+  Whole.Final(Digest);
+
+  for (int v = 0; v < 3; v++) CHECK(memcmp(Digests[v], Digest, SHA1_DIGEST_SIZE) == 0);
+}
+
+// plan a list of extents from buffers of their fill byte, and check every writer against the expected file
+static void CheckExtents(const std::vector<TestExtent> &x_Extents, uint32 x_dwSize, uint32 x_dwPieces = 0) {
+  std::vector<std::vector<uint08>> Buffers;
+  ExportPlan Plan;
+
+  for (const TestExtent &e : x_Extents) {
+    Buffers.emplace_back(e.dwSize, e.bFill);
+    Plan.Add(e.dwOffset, Buffers.back().data(), e.dwSize);
+  }
+
+  Plan.Extend(x_dwSize);
+
+  CHECK(Plan.GetSize() == x_dwSize);
+
+  if (x_dwPieces != 0) CHECK(Plan.GetExtents() == x_dwPieces);
+
+  CheckWriters(Plan, Expected(x_Extents, x_dwSize));
+}
+
+// later extents win wherever they overlap earlier ones, adjacent ones stay apart and gaps read as zeros
+static void TestLayout() {
+  // adjacent, then a gap, then a zero tail
+  CheckExtents({{0, 0x10, 'a'}, {0x10, 0x10, 'b'}, {0x40, 0x20, 'c'}}, 0x100, 3);
+
+  // added back to front
+  CheckExtents({{0x40, 0x20, 'c'}, {0x10, 0x10, 'b'}, {0, 0x10, 'a'}}, 0x60, 3);
+
+  // a later extent in the middle of an earlier one splits it
+  CheckExtents({{0, 0x100, 'a'}, {0x40, 0x20, 'b'}}, 0x100, 3);
+
+  // a later extent covering earlier ones entirely hides them
+  CheckExtents({{0x10, 0x10, 'a'}, {0x30, 0x10, 'b'}, {0, 0x80, 'c'}}, 0x80, 1);
+
+  // overlapping either end of an earlier one
+  CheckExtents({{0x20, 0x40, 'a'}, {0x10, 0x20, 'b'}, {0x50, 0x20, 'c'}}, 0x70, 3);
+
+  // the same range twice, and an earlier extent bridging two later ones
+  CheckExtents({{0, 0x100, 'a'}, {0x20, 0x20, 'b'}, {0x60, 0x20, 'c'}, {0x20, 0x20, 'd'}}, 0x100, 5);
+
+  // nothing at all but zeros
+  CheckExtents({}, 0x1000, 0);
+
+  // many extents in no particular order, of every size from a byte up
+  std::vector<TestExtent> Extents;
+  uint32 dwSeed = 12345;
+
+  for (uint32 v = 0; v < 500; v++) {
+    dwSeed = dwSeed * 1103515245 + 12345;
+    uint32 dwOffset = (dwSeed >> 8) % 0x8000;
+    dwSeed = dwSeed * 1103515245 + 12345;
+    uint32 dwSize = 1 + (dwSeed >> 8) % (v % 10 == 0 ? 0x1000 : 0x40);
+
+    Extents.push_back({dwOffset, dwSize, (uint08)(1 + v % 255)});
+  }
+
+  CheckExtents(Extents, 0x9000);
+}
+
+// extents from a mapped file are copied from the file where unmodified, and must still come out the same
+static void TestMapped() {
+  const uint32 dwSize = 0x10000;
+
+  char szTemp[] = "/tmp/exportplan-test.XXXXXX";
+
+  int fd = mkstemp(szTemp);
+
+  CHECK(fd >= 0);
+
+  if (fd < 0) return;
+
+  std::vector<uint08> Contents(dwSize);
+
+  for (uint32 v = 0; v < dwSize; v++) Contents[v] = (uint08)(v * 7 + (v >> 8));
+
+  CHECK(write(fd, Contents.data(), dwSize) == (ssize_t)dwSize);
+
+  close(fd);
+
+  MappedFile File;
+
+  CHECK(File.Open(szTemp));
+
+  unlink(szTemp);
+
+  if (File.GetData() == nullptr) return;
+
+  // a page written to since mapping has to come from memory
+  File.GetData()[0x5010] ^= 0xFF;
+  Contents[0x5010] ^= 0xFF;
+
+  uint08 Header[0x100];
+
+  memset(Header, 'h', sizeof(Header));
+
+  ExportPlan Plan;
+
+  Plan.Add(0, Header, sizeof(Header));
+  Plan.Add(0x1000, File.GetData() + 0x1000, 0x8000, &File);
+  Plan.Add(0xA000, File.GetData() + 0x4000, 0x3000, &File);
+
+  // written over part of a mapped extent
+  Plan.Add(0x2000, Header, sizeof(Header));
+
+  std::vector<uint08> Expect(0xD000, 0);
+
+  memcpy(&Expect[0], Header, sizeof(Header));
+  memcpy(&Expect[0x1000], &Contents[0x1000], 0x8000);
+  memcpy(&Expect[0xA000], &Contents[0x4000], 0x3000);
+  memcpy(&Expect[0x2000], Header, sizeof(Header));
+
+  CheckWriters(Plan, Expect);
+}
+
+void TestExportPlan() {
+  TestLayout();
+  TestMapped();
+}
@@ -0,0 +1,169 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <vector>
+
+#include "Exe.h"
+#include "ImportDirectory.h"
+#include "Test.h"
+#include "TestExe.h"
+
+// the one section of the test image
+#define TEST_SECTION_RVA 0x1000
+#define TEST_SECTION_SIZE 0x200
+
+// an import descriptor (IMAGE_IMPORT_DESCRIPTOR)
+static void PutDescriptor(TestExe &x_Exe, uint32 x_dwRVA, uint32 x_dwLookupRVA, uint32 x_dwNameRVA,
+                          uint32 x_dwThunkRVA) {
+  x_Exe.Put32(x_dwRVA + 0, x_dwLookupRVA);
+  x_Exe.Put32(x_dwRVA + 12, x_dwNameRVA);
+  x_Exe.Put32(x_dwRVA + 16, x_dwThunkRVA);
+}
+
+// a PE image with one section holding an import directory: xboxkrnl.exe imported by ordinal through a lookup
+// table, and KERNEL32.dll by name through its address table alone
+static TestExe BuildExe() {
+  TestExe Exe;
+
+  Exe.AddSection(".idata", TEST_SECTION_RVA, TEST_SECTION_SIZE, 0xC0000040, TEST_SECTION_SIZE);
+
+  Exe.Directories[IMAGE_DIRECTORY_ENTRY_IMPORT][0] = TEST_SECTION_RVA;
+  Exe.Directories[IMAGE_DIRECTORY_ENTRY_IMPORT][1] = 3 * 20;
+
+  // descriptors, ending with an all zero one
+  PutDescriptor(Exe, 0x1000, 0x1100, 0x1080, 0x1140);
+  PutDescriptor(Exe, 0x1014, 0, 0x1090, 0x1160);
+
+  Exe.PutString(0x1080, "xboxkrnl.exe");
+  Exe.PutString(0x1090, "KERNEL32.dll");
+
+  // lookup table by ordinal, and the address table as it looks once bound
+  Exe.Put32(0x1100, 0x80000001);
+  Exe.Put32(0x1104, 0x800000B8);
+  Exe.Put32(0x1140, 0x8001A2B0);
+  Exe.Put32(0x1144, 0x8001C4D0);
+
+  // address table by name, pointing at hint/name entries
+  Exe.Put32(0x1160, 0x1180);
+  Exe.Put32(0x1164, 0x1190);
+  Exe.Put32(0x1180, 5);
+  Exe.PutString(0x1182, "Sleep");
+  Exe.Put32(0x1190, 0x123);
+  Exe.PutString(0x1192, "ExitProcess");
+
+  return Exe;
+}
+
+static void TestImports() {
+  std::vector<uint08> Image = BuildExe().Build();
+
+  Exe ExeFile(Image.data(), (uint32)Image.size());
+
+  CHECK(ExeFile.GetError() == nullptr);
+
+  ImportDirectory Imports(&ExeFile);
+
+  CHECK(Imports.GetError() == nullptr);
+  CHECK(Imports.GetLibraries().size() == 2);
+  CHECK(Imports.GetImports() == 4);
+
+  if (Imports.GetLibraries().size() != 2) return;
+
+  const ImportDirectory::Library &Kernel = Imports.GetLibraries()[0];
+
+  CHECK(Kernel.Name == "xboxkrnl.exe");
+  CHECK(Kernel.dwThunkRVA == 0x1140);
+  CHECK(Kernel.Imports.size() == 2);
+
+  if (Kernel.Imports.size() == 2) {
+    CHECK(Kernel.Imports[0].dwThunkRVA == 0x1140);
+    CHECK(Kernel.Imports[0].dwOrdinal == 1);
+    CHECK(Kernel.Imports[0].wHint == 0);
+    CHECK(Kernel.Imports[0].Name.empty());
+    CHECK(Kernel.Imports[1].dwThunkRVA == 0x1144);
+    CHECK(Kernel.Imports[1].dwOrdinal == 0xB8);
+  }
+
+  const ImportDirectory::Library &Kernel32 = Imports.GetLibraries()[1];
+
+  CHECK(Kernel32.Name == "KERNEL32.dll");
+  CHECK(Kernel32.dwThunkRVA == 0x1160);
+  CHECK(Kernel32.Imports.size() == 2);
+
+  if (Kernel32.Imports.size() == 2) {
+    CHECK(Kernel32.Imports[0].dwThunkRVA == 0x1160);
+    CHECK(Kernel32.Imports[0].dwOrdinal == 0);
+    CHECK(Kernel32.Imports[0].wHint == 5);
+    CHECK(Kernel32.Imports[0].Name == "Sleep");
+    CHECK(Kernel32.Imports[1].dwThunkRVA == 0x1164);
+    CHECK(Kernel32.Imports[1].wHint == 0x123);
+    CHECK(Kernel32.Imports[1].Name == "ExitProcess");
+  }
+
+  CHECK(Imports.Find("kernel32.DLL") == &Kernel32);
+  CHECK(Imports.Find("XBOXKRNL.EXE") == &Kernel);
+  CHECK(Imports.Find("user32.dll") == nullptr);
+}
+
+// a directory that points outside the image, or at a name that runs off the end of it, is an error
+static void TestCorruptImports() {
+  {
+    TestExe Test = BuildExe();
+
+    PutDescriptor(Test, 0x1014, 0, 0x5000, 0x1160);
+
+    std::vector<uint08> Image = Test.Build();
+
+    Exe ExeFile(Image.data(), (uint32)Image.size());
+    ImportDirectory Imports(&ExeFile);
+
+    CHECK(Imports.GetError() != nullptr);
+  }
+
+  {
+    TestExe Test = BuildExe();
+
+    PutDescriptor(Test, 0x1014, 0, TEST_SECTION_RVA + TEST_SECTION_SIZE - 4, 0x1160);
+    Test.PutString(TEST_SECTION_RVA + TEST_SECTION_SIZE - 4, "abcd", false);
+
+    std::vector<uint08> Image = Test.Build();
+
+    Exe ExeFile(Image.data(), (uint32)Image.size());
+    ImportDirectory Imports(&ExeFile);
+
+    CHECK(Imports.GetError() != nullptr);
+  }
+
+  {
+    TestExe Test = BuildExe();
+
+    Test.Put32(0x1164, 0x4000);
+
+    std::vector<uint08> Image = Test.Build();
+
+    Exe ExeFile(Image.data(), (uint32)Image.size());
+    ImportDirectory Imports(&ExeFile);
+
+    CHECK(Imports.GetError() != nullptr);
+  }
+}
+
+// no import directory at all is fine, and means no imports
+static void TestNoImports() {
+  std::vector<uint08> Image = BuildExe().Build();
+
+  Exe ExeFile(Image.data(), (uint32)Image.size());
+
+  ExeFile.m_OptionalHeader.m_image_data_directory[IMAGE_DIRECTORY_ENTRY_IMPORT].m_virtual_addr = 0;
+
+  ImportDirectory Imports(&ExeFile);
+
+  CHECK(Imports.GetError() == nullptr);
+  CHECK(Imports.GetLibraries().empty());
+  CHECK(Imports.GetImports() == 0);
+}
+
+void TestImportDirectory() {
+  TestImports();
+  TestCorruptImports();
+  TestNoImports();
+}
@@ -0,0 +1,302 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <string.h>
+
+#include <vector>
+
+#include "Exe.h"
+#include "Relocation.h"
+#include "Test.h"
+
+// sections of a test image, each a buffer at a relative virtual address
+struct TestSections {
+  struct Section {
+    uint32 dwRVA;
+    std::vector<uint08> Data;
+  };
+
+  std::vector<Section> Sections;
+};
+
+static Relocation::Target Resolve(void *x_pContext, uint32 x_dwRVA) {
+  for (TestSections::Section &Section : ((TestSections *)x_pContext)->Sections) {
+    if (x_dwRVA >= Section.dwRVA && x_dwRVA - Section.dwRVA < Section.Data.size())
+      return {&Section.Data[x_dwRVA - Section.dwRVA], (uint32)(Section.Data.size() - (x_dwRVA - Section.dwRVA))};
+  }
+
+  return {nullptr, 0};
+}
+
+// append a block to a relocation table, padded to a whole number of 32-bit words as linkers do
+static void AddBlock(std::vector<uint08> &x_Table, uint32 x_dwPage, std::vector<uint16> x_Entries) {
+  if (x_Entries.size() % 2 != 0) x_Entries.push_back(IMAGE_REL_BASED_ABSOLUTE << 12);
+
+  uint32 Header[2] = {x_dwPage, (uint32)(8 + x_Entries.size() * 2)};
+
+  x_Table.insert(x_Table.end(), (uint08 *)Header, (uint08 *)(Header + 2));
+  x_Table.insert(x_Table.end(), (uint08 *)x_Entries.data(), (uint08 *)(x_Entries.data() + x_Entries.size()));
+}
+
+static uint16 Entry(uint32 x_dwType, uint32 x_dwOffset) { return (uint16)((x_dwType << 12) | x_dwOffset); }
+
+static uint32 Get32(const std::vector<uint08> &x_Data, uint32 x_dwOffset) {
+  uint32 dwValue;
+
+  memcpy(&dwValue, &x_Data[x_dwOffset], 4);
+
+  return dwValue;
+}
+
+static void Put32(std::vector<uint08> &x_Data, uint32 x_dwOffset, uint32 x_dwValue) {
+  memcpy(&x_Data[x_dwOffset], &x_dwValue, 4);
+}
+
+static uint16 Get16(const std::vector<uint08> &x_Data, uint32 x_dwOffset) {
+  uint16 wValue;
+
+  memcpy(&wValue, &x_Data[x_dwOffset], 2);
+
+  return wValue;
+}
+
+static void Put16(std::vector<uint08> &x_Data, uint32 x_dwOffset, uint16 x_wValue) {
+  memcpy(&x_Data[x_dwOffset], &x_wValue, 2);
+}
+
+// every fixup type, in a page that two sections share, with fixups that straddle the sections or miss them
+static void TestBlocks() {
+  TestSections Image;
+
+  Image.Sections.push_back({0x1000, std::vector<uint08>(0x800)});
+  Image.Sections.push_back({0x1800, std::vector<uint08>(0x1000)});
+
+  std::vector<uint08> &A = Image.Sections[0].Data;
+  std::vector<uint08> &B = Image.Sections[1].Data;
+
+  Put32(A, 0x010, 0x00011000);
+  Put16(A, 0x020, 0x0001);
+  Put16(A, 0x030, 0x1000);
+  Put16(A, 0x040, 0x0001);
+  Put32(A, 0x100, 0x00011000);
+  Put32(A, 0x7F8, 0x00000100);
+  Put16(A, 0x7FE, 0x1234);
+  Put32(B, 0x000, 0x00000200);
+  Put32(B, 0x804, 0x00000300);
+
+  std::vector<uint08> Table;
+
+  AddBlock(Table, 0x1000,
+           {Entry(IMAGE_REL_BASED_HIGHLOW, 0x010), Entry(IMAGE_REL_BASED_HIGH, 0x020),
+            Entry(IMAGE_REL_BASED_LOW, 0x030), Entry(IMAGE_REL_BASED_HIGHADJ, 0x040), 0x9000,
+            Entry(IMAGE_REL_BASED_HIGHLOW, 0x7F8),
+            Entry(IMAGE_REL_BASED_HIGHLOW, 0x7FE), Entry(IMAGE_REL_BASED_HIGHLOW, 0x800),
+            Entry(IMAGE_REL_BASED_ABSOLUTE, 0)});
+  AddBlock(Table, 0x3000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x000)});
+  AddBlock(Table, 0x2000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x004)});
+
+  // an empty block ends the table, whatever follows it
+  Table.insert(Table.end(), 8, 0);
+  AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x100)});
+
+  Relocation Relocs(Table.data(), (uint32)Table.size());
+
+  Relocs.Apply(0x00012345, Resolve, &Image);
+
+  CHECK(Relocs.GetError() == nullptr);
+
+  CHECK(Get32(A, 0x010) == 0x00023345);
+  CHECK(Get16(A, 0x020) == 0x0002);
+  CHECK(Get16(A, 0x030) == 0x3345);
+  CHECK(Get16(A, 0x040) == 0x0002);  // (0x00009000 + 0x00012345 + 0x8000) >> 16
+  CHECK(Get32(A, 0x100) == 0x00011000);
+  CHECK(Get32(A, 0x7F8) == 0x00012445);
+  CHECK(Get16(A, 0x7FE) == 0x1234);
+  CHECK(Get32(B, 0x000) == 0x00012545);
+  CHECK(Get32(B, 0x804) == 0x00012645);
+
+  const Relocation::Stats &Stats = Relocs.GetStats();
+
+  CHECK(Stats.dwBlocks == 3);
+  CHECK(Stats.dwHighLow == 4);
+  CHECK(Stats.dwHigh == 1);
+  CHECK(Stats.dwLow == 1);
+  CHECK(Stats.dwHighAdj == 1);
+  CHECK(Stats.dwAbsolute == 4);
+  CHECK(Stats.dwSkipped == 2);
+  CHECK(Stats.GetFixups() == 9);
+}
+
+// a block that claims to run past the end of the table is cut short, and unknown types (or a HIGHADJ fixup
+// without its low half) are refused
+static void TestBadTables() {
+  {
+    TestSections Image;
+
+    Image.Sections.push_back({0x1000, std::vector<uint08>(0x1000)});
+
+    std::vector<uint08> Table;
+
+    AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x010), Entry(IMAGE_REL_BASED_HIGHLOW, 0x020)});
+    Table.resize(Table.size() - 2);
+
+    Relocation Relocs(Table.data(), (uint32)Table.size());
+
+    Relocs.Apply(0x100, Resolve, &Image);
+
+    CHECK(Relocs.GetError() == nullptr);
+    CHECK(Get32(Image.Sections[0].Data, 0x010) == 0x100);
+    CHECK(Get32(Image.Sections[0].Data, 0x020) == 0);
+    CHECK(Relocs.GetStats().dwHighLow == 1);
+  }
+
+  {
+    TestSections Image;
+
+    Image.Sections.push_back({0x1000, std::vector<uint08>(0x1000)});
+
+    std::vector<uint08> Table;
+
+    AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_DIR64, 0x010)});
+
+    Relocation Relocs(Table.data(), (uint32)Table.size());
+
+    Relocs.Apply(0x100, Resolve, &Image);
+
+    CHECK(Relocs.GetError() != nullptr);
+  }
+
+  {
+    TestSections Image;
+
+    Image.Sections.push_back({0x1000, std::vector<uint08>(0x1000)});
+
+    std::vector<uint08> Table;
+
+    // the low half of a HIGHADJ fixup is missing
+    AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x010), Entry(IMAGE_REL_BASED_HIGHADJ, 0x020)});
+
+    Relocation Relocs(Table.data(), (uint32)Table.size());
+
+    Relocs.Apply(0x100, Resolve, &Image);
+
+    CHECK(Relocs.GetError() != nullptr);
+  }
+}
+
+// addresses below 0x2000 move by 0x10000, the rest by 0x20000
+static uint32 Rebase(void *, uint32 x_dwValue) {
+  return x_dwValue < 0x2000 ? x_dwValue + 0x10000 : x_dwValue + 0x20000;
+}
+
+// a rebaser relocates whole addresses, and refuses half ones
+static void TestRebaser() {
+  {
+    TestSections Image;
+
+    Image.Sections.push_back({0x1000, std::vector<uint08>(0x1000)});
+
+    Put32(Image.Sections[0].Data, 0x010, 0x1800);
+    Put32(Image.Sections[0].Data, 0x020, 0x2800);
+    Put16(Image.Sections[0].Data, 0x030, 0x0000);
+
+    std::vector<uint08> Table;
+
+    AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_HIGHLOW, 0x010), Entry(IMAGE_REL_BASED_HIGHLOW, 0x020),
+                             Entry(IMAGE_REL_BASED_HIGHADJ, 0x030), 0x2800});
+
+    Relocation Relocs(Table.data(), (uint32)Table.size());
+
+    Relocs.SetRebaser(Rebase);
+    Relocs.Apply(0, Resolve, &Image);
+
+    CHECK(Relocs.GetError() == nullptr);
+    CHECK(Get32(Image.Sections[0].Data, 0x010) == 0x11800);
+    CHECK(Get32(Image.Sections[0].Data, 0x020) == 0x22800);
+    CHECK(Get16(Image.Sections[0].Data, 0x030) == 0x0002);
+  }
+
+  {
+    TestSections Image;
+
+    Image.Sections.push_back({0x1000, std::vector<uint08>(0x1000)});
+
+    std::vector<uint08> Table;
+
+    AddBlock(Table, 0x1000, {Entry(IMAGE_REL_BASED_HIGH, 0x010)});
+
+    Relocation Relocs(Table.data(), (uint32)Table.size());
+
+    Relocs.SetRebaser(Rebase);
+    Relocs.Apply(0, Resolve, &Image);
+
+    CHECK(Relocs.GetError() != nullptr);
+  }
+}
+
+// a table big enough to be spread over the thread pool (when there is more than one core) gives exactly what
+// applying it in order does, and so does one whose pages are not in order
+static void TestParallel() {
+  const uint32 dwPages = 0x200;
+
+  TestSections Serial;
+
+  Serial.Sections.push_back({0x10000, std::vector<uint08>(dwPages * 0x1000)});
+
+  for (uint32 v = 0; v < dwPages * 0x1000; v += 4) Put32(Serial.Sections[0].Data, v, v * 0x9E3779B1);
+
+  TestSections Parallel = Serial;
+  TestSections Unordered = Serial;
+
+  std::vector<uint08> Table, UnorderedTable;
+
+  for (uint32 p = 0; p < dwPages; p++) {
+    std::vector<uint16> Entries;
+
+    for (uint32 o = (p * 12) % 64; o < 0x1000; o += 64) Entries.push_back(Entry(IMAGE_REL_BASED_HIGHLOW, o));
+
+    AddBlock(Table, 0x10000 + p * 0x1000, Entries);
+  }
+
+  // the same blocks, last page first
+  for (uint32 p = dwPages; p-- > 0;) {
+    std::vector<uint16> Entries;
+
+    for (uint32 o = (p * 12) % 64; o < 0x1000; o += 64) Entries.push_back(Entry(IMAGE_REL_BASED_HIGHLOW, o));
+
+    AddBlock(UnorderedTable, 0x10000 + p * 0x1000, Entries);
+  }
+
+  Relocation SerialRelocs(Table.data(), (uint32)Table.size());
+  Relocation ParallelRelocs(Table.data(), (uint32)Table.size());
+  Relocation UnorderedRelocs(UnorderedTable.data(), (uint32)UnorderedTable.size());
+
+  SerialRelocs.Apply(0x00400000, Resolve, &Serial, false);
+  ParallelRelocs.Apply(0x00400000, Resolve, &Parallel, true);
+  UnorderedRelocs.Apply(0x00400000, Resolve, &Unordered, true);
+
+  CHECK(SerialRelocs.GetError() == nullptr);
+  CHECK(ParallelRelocs.GetError() == nullptr);
+  CHECK(UnorderedRelocs.GetError() == nullptr);
+
+  CHECK(SerialRelocs.GetThreads() == 1);
+  CHECK(UnorderedRelocs.GetThreads() == 1);
+
+  CHECK(SerialRelocs.GetStats().dwHighLow == dwPages * 64);
+  CHECK(ParallelRelocs.GetStats().dwHighLow == dwPages * 64);
+  CHECK(ParallelRelocs.GetStats().dwBlocks == dwPages);
+  CHECK(UnorderedRelocs.GetStats().dwHighLow == dwPages * 64);
+
+  CHECK(Parallel.Sections[0].Data == Serial.Sections[0].Data);
+  CHECK(Unordered.Sections[0].Data == Serial.Sections[0].Data);
+
+  // and every fixup was applied once
+  CHECK(Get32(Serial.Sections[0].Data, 0) == 0x00400000);
+  CHECK(Get32(Serial.Sections[0].Data, 64) == 64 * 0x9E3779B1 + 0x00400000);
+}
+
+void TestRelocation() {
+  TestBlocks();
+  TestBadTables();
+  TestRebaser();
+  TestParallel();
+}
@@ -0,0 +1,140 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <vector>
+
+#include "Exe.h"
+#include "SectionIndex.h"
+#include "Test.h"
+#include "TestExe.h"
+
+// sections given out of order, with a gap between two of them and an empty one, found one at a time
+static void TestFind() {
+  SectionIndex Index;
+
+  Index.Add(0, 0x3000, 0x100);
+  Index.Add(1, 0x1000, 0x1000);
+  Index.Add(2, 0x2000, 0x800);
+  Index.Add(3, 0x2800, 0);
+
+  CHECK(!Index.IsBuilt());
+  CHECK(Index.Build());
+  CHECK(Index.IsBuilt());
+
+  CHECK(Index.Find(0x0FFF) == -1);
+  CHECK(Index.Find(0x1000) == 1);
+  CHECK(Index.Find(0x1FFF) == 1);
+  CHECK(Index.Find(0x2000) == 2);
+  CHECK(Index.Find(0x27FF) == 2);
+
+  // the gap (the empty section in it included) and past the end
+  CHECK(Index.Find(0x2800) == -1);
+  CHECK(Index.Find(0x2FFF) == -1);
+  CHECK(Index.Find(0x3000) == 0);
+  CHECK(Index.Find(0x3100) == -1);
+  CHECK(Index.Find(0xFFFFFFFF) == -1);
+
+  // the same section again, after a hit in it is remembered
+  CHECK(Index.Find(0x1800) == 1);
+  CHECK(Index.Find(0x1004) == 1);
+  CHECK(Index.Find(0x3004) == 0);
+}
+
+// sorted addresses resolve in one pass, unsorted ones still resolve the same
+static void TestFindSorted() {
+  SectionIndex Index;
+
+  Index.Add(0, 0x1000, 0x1000);
+  Index.Add(1, 0x2000, 0x800);
+  Index.Add(2, 0x3000, 0x100);
+
+  CHECK(Index.Build());
+
+  const uint32 dwSorted[] = {0x0800, 0x1000, 0x1004, 0x1FFF, 0x2000, 0x2900, 0x3000, 0x30FF, 0x3100};
+  const sint32 Sorted[] = {-1, 0, 0, 0, 1, -1, 2, 2, -1};
+  const uint32 dwCount = sizeof(dwSorted) / sizeof(dwSorted[0]);
+
+  std::vector<sint32> Sections(dwCount);
+
+  Index.FindSorted(dwSorted, Sections.data(), dwCount);
+
+  for (uint32 v = 0; v < dwCount; v++) CHECK(Sections[v] == Sorted[v]);
+
+  const uint32 dwUnsorted[] = {0x3004, 0x1004, 0x2900, 0x2004, 0x0800, 0x3000, 0x1FFF, 0x4000, 0x1000};
+  const sint32 Unsorted[] = {2, 0, -1, 1, -1, 2, 0, -1, 0};
+
+  Index.FindSorted(dwUnsorted, Sections.data(), dwCount);
+
+  for (uint32 v = 0; v < dwCount; v++) {
+    CHECK(Sections[v] == Unsorted[v]);
+    CHECK(Index.Find(dwUnsorted[v]) == Unsorted[v]);
+  }
+}
+
+// overlapping sections cannot be searched in order, so the index refuses them until rebuilt without
+static void TestOverlap() {
+  SectionIndex Index;
+
+  Index.Add(0, 0x1000, 0x1000);
+  Index.Add(1, 0x1800, 0x1000);
+
+  CHECK(!Index.Build());
+  CHECK(!Index.IsBuilt());
+
+  // ranges that only touch do not overlap
+  Index.Clear();
+  Index.Add(0, 0x1000, 0x800);
+  Index.Add(1, 0x1800, 0x1000);
+
+  CHECK(Index.Build());
+  CHECK(Index.Find(0x17FF) == 0);
+  CHECK(Index.Find(0x1800) == 1);
+}
+
+// Exe lookups only point at raw data that is held, and never load or copy a section for it
+static void TestExeAddrs() {
+  TestExe Image;
+
+  Image.AddSection(".text", 0x1000, 0x100, IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ, 0x200);
+  Image.AddSection(".bss", 0x2000, 0x800, IMAGE_SCN_CNT_UNINITIALIZED_DATA | IMAGE_SCN_MEM_READ, 0x200);
+
+  Image.Put32(0x1010, 0x12345678);
+  Image.Put32(0x2004, 0x9ABCDEF0);
+
+  std::vector<uint08> Buffer = Image.Build();
+
+  Exe ExeFile(Buffer.data(), (uint32)Buffer.size());
+
+  CHECK(ExeFile.GetError() == nullptr);
+
+  if (ExeFile.GetError() != nullptr) return;
+
+  uint08 *bzText = ExeFile.m_bzSection[0];
+  uint08 *bzData = ExeFile.m_bzSection[1];
+
+  CHECK(ExeFile.GetAddr(0x1010) == bzText + 0x10);
+  CHECK(ExeFile.GetAddr(0x2004) == bzData + 4);
+
+  // past the raw data, between sections and before the first one
+  CHECK(ExeFile.GetAddr(0x2200) == nullptr);
+  CHECK(ExeFile.GetAddr(0x1800) == nullptr);
+  CHECK(ExeFile.GetAddr(0x0800) == nullptr);
+
+  const uint32 dwAddrs[] = {0x1000, 0x1010, 0x1800, 0x2004, 0x21FF, 0x2200, 0x1004};
+  const uint08 *Expected[] = {bzText, bzText + 0x10, nullptr, bzData + 4, bzData + 0x1FF, nullptr, bzText + 4};
+  const uint08 *pAddrs[7];
+
+  ExeFile.GetAddrs(dwAddrs, pAddrs, 7);
+
+  for (uint32 v = 0; v < 7; v++) CHECK(pAddrs[v] == Expected[v]);
+
+  // the sections still point into the image
+  CHECK(ExeFile.m_bzSection[0] == bzText && ExeFile.m_bzSection[1] == bzData);
+  CHECK(bzText >= Buffer.data() && bzText < Buffer.data() + Buffer.size());
+}
+
+void TestSectionIndex() {
+  TestFind();
+  TestFindSorted();
+  TestOverlap();
+  TestExeAddrs();
+}
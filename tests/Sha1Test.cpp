@@ -0,0 +1,145 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Sha1.h"
+#include "Test.h"
+
+// a message and its digest, in hex
+struct Sha1Vector {
+  std::string Message;
+  const char *szDigest;
+};
+
+static std::string HexDigest(const uint08 x_Digest[SHA1_DIGEST_SIZE]) {
+  char szHex[SHA1_DIGEST_SIZE * 2 + 1];
+
+  for (uint32 v = 0; v < SHA1_DIGEST_SIZE; v++) snprintf(&szHex[v * 2], 3, "%02x", x_Digest[v]);
+
+  return szHex;
+}
+
+// bytes that are not all alike, x_dwSize of them
+static std::string Pattern(uint32 x_dwSize) {
+  std::string Message(x_dwSize, 0);
+
+  for (uint32 v = 0; v < x_dwSize; v++) Message[v] = (char)((v * 7 + 1) & 0xFF);
+
+  return Message;
+}
+
+static std::vector<Sha1Vector> GetVectors() {
+  return {
+      // FIPS 180 examples
+      {"", "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+      {"abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+      {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+      {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+       "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+       "a49b2446a02c645bf419f995b67091253a04a259"},
+      {"The quick brown fox jumps over the lazy dog", "2fd4e1c67a2d28fced849ee1bb76e7391b93eb12"},
+      {std::string(1000000, 'a'), "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+
+      // either side of where the length no longer fits in the last block
+      {Pattern(55), "04bb34aef4880b625e6b1564a014abd25fc02bfe"},
+      {Pattern(56), "83b9fcb6d3e3b20f376ab989a1b6353bcc6c0f44"},
+      {Pattern(63), "ab15090e8dbe512f3733350f9623ab11f9b5165b"},
+      {Pattern(64), "54305ee7e4c7bc5a96afc6d1994fc52d9bcb665f"},
+      {Pattern(65), "5985422a25357371ebd2a7f6ecd7eebed43db42c"},
+      {Pattern(119), "6839d6c27f22ed884ac43ae6bd3bfcee9e04b938"},
+      {Pattern(120), "8c40517a14ab8b78fd4b8958f4e31254a34c3fb0"},
+      {Pattern(128), "22485dc0d1e1d6e9e93e4a2a4667b8e979456379"},
+      {Pattern(1000), "f50d11c8ae2b20fe2598e99a6a2cb859e302615c"},
+  };
+}
+
+// every vector through the Sha1 class, in one piece and in uneven pieces
+static void TestSha1Class(const std::vector<Sha1Vector> &x_Vectors) {
+  for (const Sha1Vector &Vector : x_Vectors) {
+    uint08 Digest[SHA1_DIGEST_SIZE];
+
+    Sha1 Hash;
+
+    Hash.Update(Vector.Message.data(), Vector.Message.size());
+    Hash.Final(Digest);
+
+    CHECK(HexDigest(Digest) == Vector.szDigest);
+
+    Hash.Reset();
+
+    for (size_t dwDone = 0, dwPiece = 1; dwDone < Vector.Message.size(); dwDone += dwPiece, dwPiece = dwPiece * 3 + 1) {
+      if (dwPiece > Vector.Message.size() - dwDone) dwPiece = Vector.Message.size() - dwDone;
+
+      Hash.Update(&Vector.Message[dwDone], dwPiece);
+    }
+
+    Hash.Final(Digest);
+
+    CHECK(HexDigest(Digest) == Vector.szDigest);
+  }
+}
+
+// every vector through Sha1Many, split between prefix and data at several points, with enough messages of
+// different lengths that lanes run out and are refilled at different times
+static void TestSha1Many(const std::vector<Sha1Vector> &x_Vectors) {
+  std::vector<Sha1Message> Messages;
+  std::vector<const char *> Expected;
+
+  for (const Sha1Vector &Vector : x_Vectors) {
+    const uint08 *pMessage = (const uint08 *)Vector.Message.data();
+    uint32 dwSize = (uint32)Vector.Message.size();
+
+    for (uint32 dwPrefix : {0u, 1u, 64u, dwSize / 2, dwSize}) {
+      if (dwPrefix > dwSize) continue;
+
+      Messages.push_back({pMessage, dwPrefix, pMessage + dwPrefix, dwSize - dwPrefix, nullptr});
+      Expected.push_back(Vector.szDigest);
+    }
+  }
+
+  std::vector<uint08> Digests(Messages.size() * SHA1_DIGEST_SIZE);
+
+  for (uint32 v = 0; v < Messages.size(); v++) Messages[v].pDigest = &Digests[v * SHA1_DIGEST_SIZE];
+
+  Sha1Many(Messages.data(), (uint32)Messages.size());
+
+  for (uint32 v = 0; v < Messages.size(); v++) CHECK(HexDigest(Messages[v].pDigest) == Expected[v]);
+
+  // a single message takes another path
+  memset(Digests.data(), 0, SHA1_DIGEST_SIZE);
+
+  Sha1Many(Messages.data(), 1);
+
+  CHECK(HexDigest(Messages[0].pDigest) == Expected[0]);
+}
+
+void TestSha1() {
+  static const char *Engines[] = {"Scalar", "SSE2, 4 Lanes", "AVX2, 8 Lanes", "SHA Extensions"};
+
+  std::string Best = Sha1Engine();
+
+  std::vector<Sha1Vector> Vectors = GetVectors();
+
+  for (const char *szEngine : Engines) {
+    if (!Sha1UseEngine(szEngine)) {
+      printf("Sha1: %s is not supported here, skipped\n", szEngine);
+      continue;
+    }
+
+    CHECK(strcmp(Sha1Engine(), szEngine) == 0);
+
+    unsigned int dwFailures = g_TestFailures;
+
+    TestSha1Class(Vectors);
+    TestSha1Many(Vectors);
+
+    if (g_TestFailures != dwFailures) printf("Sha1: %s failed\n", szEngine);
+  }
+
+  CHECK(Sha1UseEngine(Best.c_str()));
+  CHECK(!Sha1UseEngine("No Such Engine"));
+}
@@ -0,0 +1,30 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// number of checks that failed so far
+extern unsigned int g_TestFailures;
+
+// report a failed check, carrying on with the rest of the test
+#define CHECK(x_Condition)                                                                  \
+  do {                                                                                      \
+    if (!(x_Condition)) {                                                                   \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x_Condition);                \
+      g_TestFailures++;                                                                     \
+    }                                                                                       \
+  } while (0)
+
+// the tests, one per module
+void TestZeroScan();
+void TestSha1();
+void TestExportPlan();
+void TestImportDirectory();
+void TestRelocation();
+void TestSectionIndex();
+void TestConvertCache();
+void TestXbe();
+
+#endif
@@ -0,0 +1,109 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "TestExe.h"
+
+#include <string.h>
+
+#include "Exe.h"
+#include "Test.h"
+
+// file offset of the first section's raw data
+#define TESTEXE_HEADERS 0x400
+
+// add a section
+uint32 TestExe::AddSection(const char *x_szName, uint32 x_dwRVA, uint32 x_dwVirtualSize, uint32 x_dwCharacteristics,
+                           uint32 x_dwSizeofRaw) {
+  Sections.push_back({x_szName, x_dwRVA, x_dwVirtualSize, x_dwCharacteristics, std::vector<uint08>(x_dwSizeofRaw)});
+
+  return (uint32)Sections.size() - 1;
+}
+
+// where a relative virtual address lies in a section's data
+uint08 *TestExe::Find(uint32 x_dwRVA, uint32 x_dwSize) {
+  for (Section &S : Sections)
+    if (x_dwRVA >= S.dwRVA && x_dwRVA - S.dwRVA + x_dwSize <= S.Data.size()) return &S.Data[x_dwRVA - S.dwRVA];
+
+  printf("TestExe: nothing at %08X\n", x_dwRVA);
+  g_TestFailures++;
+
+  return nullptr;
+}
+
+void TestExe::Put32(uint32 x_dwRVA, uint32 x_dwValue) {
+  uint08 *p = Find(x_dwRVA, 4);
+
+  if (p != nullptr) memcpy(p, &x_dwValue, 4);
+}
+
+void TestExe::Put16(uint32 x_dwRVA, uint16 x_wValue) {
+  uint08 *p = Find(x_dwRVA, 2);
+
+  if (p != nullptr) memcpy(p, &x_wValue, 2);
+}
+
+void TestExe::PutString(uint32 x_dwRVA, const char *x_szValue, bool x_bTerminate) {
+  uint32 dwSize = (uint32)strlen(x_szValue) + (x_bTerminate ? 1 : 0);
+
+  uint08 *p = Find(x_dwRVA, dwSize);
+
+  if (p != nullptr) memcpy(p, x_szValue, dwSize);
+}
+
+// the whole file
+std::vector<uint08> TestExe::Build() const {
+  Exe::DOSHeader DOSHeader{};
+  Exe::Header Header{};
+  Exe::OptionalHeader OptionalHeader{};
+
+  memcpy(&DOSHeader.m_magic, "MZ", 2);
+  DOSHeader.m_lfanew = 0x80;
+
+  memcpy(&Header.m_magic, "PE\0\0", 4);
+  Header.m_machine = 0x014C;
+  Header.m_sections = (uint16)Sections.size();
+  Header.m_sizeof_optional_header = sizeof(OptionalHeader);
+
+  OptionalHeader.m_magic = 0x010B;
+  OptionalHeader.m_entry = dwEntry;
+  OptionalHeader.m_image_base = dwImageBase;
+  OptionalHeader.m_section_alignment = 0x1000;
+  OptionalHeader.m_file_alignment = 0x200;
+  OptionalHeader.m_sizeof_headers = TESTEXE_HEADERS;
+  OptionalHeader.m_sizeof_stack_reserve = 0x10000;
+  OptionalHeader.m_data_directories = 0x10;
+
+  for (uint32 v = 0; v < 0x10; v++) {
+    OptionalHeader.m_image_data_directory[v].m_virtual_addr = Directories[v][0];
+    OptionalHeader.m_image_data_directory[v].m_size = Directories[v][1];
+  }
+
+  std::vector<uint08> Image(TESTEXE_HEADERS);
+
+  uint32 dwOffset = DOSHeader.m_lfanew + sizeof(Header) + sizeof(OptionalHeader);
+
+  for (const Section &S : Sections) {
+    Exe::SectionHeader SectionHeader{};
+
+    memcpy(SectionHeader.m_name, S.Name.data(), S.Name.size() < 8 ? S.Name.size() : 8);
+    SectionHeader.m_virtual_size = S.dwVirtualSize;
+    SectionHeader.m_virtual_addr = S.dwRVA;
+    SectionHeader.m_sizeof_raw = (uint32)S.Data.size();
+    SectionHeader.m_raw_addr = S.Data.empty() ? 0 : (uint32)Image.size();
+    SectionHeader.m_characteristics = S.dwCharacteristics;
+
+    memcpy(&Image[dwOffset], &SectionHeader, sizeof(SectionHeader));
+    dwOffset += sizeof(SectionHeader);
+
+    Image.insert(Image.end(), S.Data.begin(), S.Data.end());
+
+    uint32 dwEnd = S.dwRVA + (S.dwVirtualSize > S.Data.size() ? S.dwVirtualSize : (uint32)S.Data.size());
+
+    if (dwEnd > OptionalHeader.m_sizeof_image) OptionalHeader.m_sizeof_image = (dwEnd + 0xFFF) & ~0xFFF;
+  }
+
+  memcpy(&Image[0], &DOSHeader, sizeof(DOSHeader));
+  memcpy(&Image[DOSHeader.m_lfanew], &Header, sizeof(Header));
+  memcpy(&Image[DOSHeader.m_lfanew + sizeof(Header)], &OptionalHeader, sizeof(OptionalHeader));
+
+  return Image;
+}
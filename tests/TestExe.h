@@ -0,0 +1,46 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#ifndef TESTEXE_H
+#define TESTEXE_H
+
+#include <string>
+#include <vector>
+
+#include "Cxbx.h"
+
+// a small PE image for tests, built from its sections (raw data follows the headers in section order)
+struct TestExe {
+  struct Section {
+    std::string Name;
+    uint32 dwRVA;
+    uint32 dwVirtualSize;
+    uint32 dwCharacteristics;
+    std::vector<uint08> Data;
+  };
+
+  std::vector<Section> Sections;
+
+  uint32 dwImageBase{0x00010000};
+  uint32 dwEntry{0};
+
+  // data directories, relative virtual address and size
+  uint32 Directories[0x10][2]{};
+
+  // add a section, returning its index
+  uint32 AddSection(const char *x_szName, uint32 x_dwRVA, uint32 x_dwVirtualSize, uint32 x_dwCharacteristics,
+                    uint32 x_dwSizeofRaw);
+
+  // bytes of a section at a relative virtual address inside it
+  void Put32(uint32 x_dwRVA, uint32 x_dwValue);
+  void Put16(uint32 x_dwRVA, uint16 x_wValue);
+  void PutString(uint32 x_dwRVA, const char *x_szValue, bool x_bTerminate = true);
+
+  // the whole file
+  std::vector<uint08> Build() const;
+
+ private:
+  // where a relative virtual address lies in a section's data
+  uint08 *Find(uint32 x_dwRVA, uint32 x_dwSize);
+};
+
+#endif
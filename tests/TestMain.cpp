@@ -0,0 +1,40 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include "Log.h"
+#include "Test.h"
+
+unsigned int g_TestFailures = 0;
+
+static const struct {
+  const char *szName;
+  void (*Run)();
+} Tests[] = {
+    {"ZeroScan", TestZeroScan},
+    {"Sha1", TestSha1},
+    {"ExportPlan", TestExportPlan},
+    {"ImportDirectory", TestImportDirectory},
+    {"Relocation", TestRelocation},
+    {"SectionIndex", TestSectionIndex},
+    {"ConvertCache", TestConvertCache},
+    {"Xbe", TestXbe},
+};
+
+int main() {
+  // only the results
+  SetLogLevel(LL_NONE);
+
+  for (const auto &Test : Tests) {
+    unsigned int dwFailures = g_TestFailures;
+
+    Test.Run();
+
+    printf("%-20s %s\n", Test.szName, g_TestFailures == dwFailures ? "OK" : "FAILED");
+  }
+
+  if (g_TestFailures != 0) {
+    printf("%u checks failed\n", g_TestFailures);
+    return 1;
+  }
+
+  return 0;
+}
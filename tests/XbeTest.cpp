@@ -0,0 +1,264 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "Exe.h"
+#include "Sha1.h"
+#include "Test.h"
+#include "TestExe.h"
+#include "Xbe.h"
+
+// an Exe with code and an unnamed data section, both holding something to digest
+static TestExe BuildExe() {
+  TestExe Exe;
+
+  Exe.AddSection(".text", 0x1000, 0x100, IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ, 0x200);
+  Exe.AddSection("", 0x2000, 0x100, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE,
+                 0x200);
+
+  Exe.dwEntry = 0x1000;
+
+  for (uint32 v = 0; v < 0x80; v += 4) {
+    Exe.Put32(0x1000 + v, 0x90909090 ^ v);
+    Exe.Put32(0x2000 + v, 0x12345678 + v);
+  }
+
+  return Exe;
+}
+
+// convert the test Exe to an Xbe file image
+static std::vector<uint08> BuildXbe(uint32 x_dwLayout = XL_DEFAULT) {
+  std::vector<uint08> Image = BuildExe().Build();
+  std::vector<uint08> Buffer;
+
+  Exe ExeFile(Image.data(), (uint32)Image.size());
+
+  CHECK(ExeFile.GetError() == nullptr);
+
+  Xbe XbeFile(&ExeFile, "Test", true, x_dwLayout);
+
+  CHECK(XbeFile.GetError() == nullptr);
+
+  XbeFile.Export(Buffer);
+
+  CHECK(XbeFile.GetError() == nullptr);
+
+  return Buffer;
+}
+
+// digest every section of an Xbe file image, returns the sections whose digest is not the one their header holds
+static std::vector<uint32> VerifyXbe(std::vector<uint08> x_Buffer) {
+  std::vector<uint32> Failed;
+
+  Xbe XbeFile(x_Buffer.data(), (uint32)x_Buffer.size());
+
+  CHECK(XbeFile.GetError() == nullptr);
+
+  if (XbeFile.GetError() != nullptr) return Failed;
+
+  std::vector<uint08> Digests(XbeFile.m_Header.dwSections * SHA1_DIGEST_SIZE);
+  std::vector<Sha1Message> Messages;
+
+  CHECK(XbeFile.GetSectionMessages(Messages, Digests.data()));
+
+  Sha1Many(Messages.data(), (uint32)Messages.size());
+
+  CHECK(XbeFile.CheckSectionDigests(Digests.data(), Failed) == Failed.size());
+
+  return Failed;
+}
+
+// a section that no longer matches its digest fails, whether or not it has a name
+static void TestSectionDigests() {
+  std::vector<uint08> Buffer = BuildXbe();
+
+  CHECK(VerifyXbe(Buffer).empty());
+
+  Xbe XbeFile(Buffer.data(), (uint32)Buffer.size());
+
+  CHECK(XbeFile.m_Header.dwSections == 2);
+
+  if (XbeFile.m_Header.dwSections != 2) return;
+
+  CHECK(XbeFile.GetSectionLabel(0) == ".text");
+  CHECK(XbeFile.GetSectionLabel(1) == "#1");
+
+  uint32 dwRaw[2] = {XbeFile.m_SectionHeader[0].dwRawAddr, XbeFile.m_SectionHeader[1].dwRawAddr};
+
+  for (uint32 v = 0; v < 2; v++) {
+    std::vector<uint08> Corrupt = Buffer;
+
+    Corrupt[dwRaw[v] + 0x10] ^= 1;
+
+    std::vector<uint32> Failed = VerifyXbe(Corrupt);
+
+    CHECK(Failed.size() == 1 && Failed[0] == v);
+  }
+}
+
+// a converted Xbe keeps one copy of its section headers, in the extra header bytes it writes out
+static void TestSectionHeaders() {
+  std::vector<uint08> Image = BuildExe().Build();
+
+  Exe ExeFile(Image.data(), (uint32)Image.size());
+
+  Xbe XbeFile(&ExeFile, "Test", true);
+
+  CHECK(XbeFile.GetError() == nullptr);
+
+  if (XbeFile.GetError() != nullptr) return;
+
+  uint32 dwOffs = XbeFile.m_Header.dwSectionHeadersAddr - XbeFile.m_Header.dwBaseAddr;
+
+  CHECK((char *)XbeFile.m_SectionHeader == XbeFile.m_HeaderEx + dwOffs - sizeof(XbeFile.m_Header));
+
+  std::vector<uint08> Buffer;
+
+  XbeFile.Export(Buffer);
+
+  // what was written holds the digests and flags set once the sections were final
+  const uint08 Zeros[SHA1_DIGEST_SIZE] = {0};
+
+  for (uint32 v = 0; v < XbeFile.m_Header.dwSections; v++) {
+    CHECK(memcmp(XbeFile.m_SectionHeader[v].bzSectionDigest, Zeros, SHA1_DIGEST_SIZE) != 0);
+    CHECK(memcmp(&Buffer[dwOffs + v * sizeof(*XbeFile.m_SectionHeader)], &XbeFile.m_SectionHeader[v],
+                 sizeof(*XbeFile.m_SectionHeader)) == 0);
+  }
+}
+
+// index of the section an Xbe calls x_szName, or its section count if there is none
+static uint32 FindSection(Xbe &x_Xbe, const char *x_szName) {
+  uint32 v = 0;
+
+  while (v < x_Xbe.m_Header.dwSections && x_Xbe.GetSectionLabel(v) != x_szName) v++;
+
+  return v;
+}
+
+static uint32 Get32(const uint08 *x_pData) {
+  uint32 dwValue;
+
+  memcpy(&dwValue, x_pData, 4);
+
+  return dwValue;
+}
+
+// sharing pages moves data sections down, and relocated addresses follow them, the end of a section included
+static void TestSharedPages() {
+  TestExe Exe;
+
+  const uint32 dwCode = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+  const uint32 dwData = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
+  // a full page of data that ends right where more code starts, then a small section that can move down
+  Exe.AddSection(".text", 0x1000, 0x100, dwCode, 0x200);
+  Exe.AddSection(".data", 0x2000, 0x1000, dwData, 0x1000);
+  Exe.AddSection(".text2", 0x3000, 0x100, dwCode, 0x200);
+  Exe.AddSection(".rdata", 0x4000, 0x48, dwData, 0x200);
+  Exe.AddSection(".reloc", 0x5000, 0x18, dwData, 0x200);
+
+  Exe.dwEntry = 0x1000;
+
+  // the end and the start of .data, and the end of .rdata
+  Exe.Put32(0x2000, Exe.dwImageBase + 0x3000);
+  Exe.Put32(0x2004, Exe.dwImageBase + 0x2000);
+  Exe.Put32(0x4000, Exe.dwImageBase + 0x4048);
+
+  // one block per page, each padded to a whole number of 32-bit words
+  Exe.Put32(0x5000, 0x2000);
+  Exe.Put32(0x5004, 12);
+  Exe.Put16(0x5008, (IMAGE_REL_BASED_HIGHLOW << 12) | 0x000);
+  Exe.Put16(0x500A, (IMAGE_REL_BASED_HIGHLOW << 12) | 0x004);
+  Exe.Put32(0x500C, 0x4000);
+  Exe.Put32(0x5010, 12);
+  Exe.Put16(0x5014, (IMAGE_REL_BASED_HIGHLOW << 12) | 0x000);
+  Exe.Put16(0x5016, IMAGE_REL_BASED_ABSOLUTE << 12);
+
+  Exe.Directories[IMAGE_DIRECTORY_ENTRY_BASERELOC][0] = 0x5000;
+  Exe.Directories[IMAGE_DIRECTORY_ENTRY_BASERELOC][1] = 0x18;
+
+  std::vector<uint08> Image = Exe.Build();
+
+  class Exe ExeFile(Image.data(), (uint32)Image.size());
+
+  CHECK(ExeFile.GetError() == nullptr);
+
+  Xbe XbeFile(&ExeFile, "Test", true, XL_SHARE_PAGES);
+
+  CHECK(XbeFile.GetError() == nullptr);
+
+  if (XbeFile.GetError() != nullptr) return;
+
+  uint32 dwData0 = FindSection(XbeFile, ".data");
+  uint32 dwCode2 = FindSection(XbeFile, ".text2");
+  uint32 dwData1 = FindSection(XbeFile, ".rdata");
+
+  CHECK(dwData0 < XbeFile.m_Header.dwSections && dwCode2 < XbeFile.m_Header.dwSections &&
+        dwData1 < XbeFile.m_Header.dwSections);
+
+  if (dwData0 >= XbeFile.m_Header.dwSections || dwCode2 >= XbeFile.m_Header.dwSections ||
+      dwData1 >= XbeFile.m_Header.dwSections)
+    return;
+
+  uint32 dwDataAddr = XbeFile.m_SectionHeader[dwData0].dwVirtualAddr;
+  uint32 dwCodeAddr = XbeFile.m_SectionHeader[dwCode2].dwVirtualAddr;
+  uint32 dwRDataAddr = XbeFile.m_SectionHeader[dwData1].dwVirtualAddr;
+
+  // .data's end is where .text2 starts, and an address of it still points there
+  CHECK(dwDataAddr + 0x1000 == dwCodeAddr);
+  CHECK(Get32(XbeFile.GetSection(dwData0)) == dwDataAddr + 0x1000);
+  CHECK(Get32(XbeFile.GetSection(dwData0) + 4) == dwDataAddr);
+
+  // .rdata shares .text2's last page, keeps its alignment within XBE_SHARED_ALIGN and its end moves along
+  CHECK(dwRDataAddr < dwCodeAddr + 0x1000);
+  CHECK(dwRDataAddr % XBE_SHARED_ALIGN == 0x4000 % XBE_SHARED_ALIGN);
+  CHECK(Get32(XbeFile.GetSection(dwData1)) == dwRDataAddr + 0x48);
+}
+
+// a file that cannot seek (a pipe) reads the same as the image it carries, whichever way it is loaded
+static void TestPipedXbe() {
+  std::vector<uint08> Buffer = BuildXbe();
+
+  const LoadMode Modes[] = {LM_COPY, LM_MAPPED, LM_LAZY};
+
+  for (LoadMode Mode : Modes) {
+    int fds[2];
+
+    CHECK(pipe(fds) == 0);
+
+    // the test Xbe is far smaller than what a pipe holds, so all of it can be written before it is read
+    CHECK(write(fds[1], Buffer.data(), Buffer.size()) == (ssize_t)Buffer.size());
+    close(fds[1]);
+
+    char szPath[32];
+
+    snprintf(szPath, sizeof(szPath), "/dev/fd/%d", fds[0]);
+
+    Xbe XbeFile(szPath, Mode);
+
+    close(fds[0]);
+
+    CHECK(XbeFile.GetError() == nullptr);
+
+    if (XbeFile.GetError() != nullptr) continue;
+
+    CHECK(XbeFile.m_Header.dwSections == 2);
+    CHECK(XbeFile.GetSectionLabel(0) == ".text");
+
+    uint08 *pCode = XbeFile.GetSection(0);
+
+    CHECK(pCode != nullptr && memcmp(pCode, &Buffer[XbeFile.m_SectionHeader[0].dwRawAddr], 0x80) == 0);
+  }
+}
+
+void TestXbe() {
+  TestSectionDigests();
+  TestSectionHeaders();
+  TestSharedPages();
+  TestPipedXbe();
+}
@@ -0,0 +1,56 @@
+// Licensed under GPLv2 or (at your option) any later version.
+
+#include <string.h>
+
+#include <vector>
+
+#include "Test.h"
+#include "ZeroScan.h"
+
+// what TrimZeros should return, a byte at a time
+static uint32 TrimZerosSlowly(const uint08 *x_pData, uint32 x_dwSize) {
+  while (x_dwSize > 0 && x_pData[x_dwSize - 1] == 0) x_dwSize--;
+
+  return x_dwSize;
+}
+
+void TestZeroScan() {
+  // room for every size across the 128, 64, 32, 16 and 8 byte steps, at every alignment within a vector
+  std::vector<uint08> Buffer(512 + 32);
+
+  CHECK(TrimZeros(Buffer.data(), 0) == 0);
+  CHECK(TrimZeros(Buffer.data(), (uint32)Buffer.size()) == 0);
+
+  for (uint32 dwAlign = 0; dwAlign < 32; dwAlign++) {
+    uint08 *pData = &Buffer[dwAlign];
+
+    for (uint32 dwSize = 0; dwSize <= 512; dwSize++) {
+      // all zeros, then the last non-zero byte at every position
+      CHECK(TrimZeros(pData, dwSize) == 0);
+
+      for (uint32 dwLast = 0; dwLast < dwSize; dwLast++) {
+        pData[dwLast] = (uint08)(dwLast | 1);
+
+        uint32 dwTrimmed = TrimZeros(pData, dwSize);
+
+        if (dwTrimmed != dwLast + 1) {
+          printf("TrimZeros: align %u size %u last %u gave %u\n", dwAlign, dwSize, dwLast, dwTrimmed);
+          g_TestFailures++;
+        }
+
+        pData[dwLast] = 0;
+      }
+    }
+  }
+
+  // bytes before the zero tail do not matter, whatever they are
+  for (uint32 v = 0; v < Buffer.size(); v++) Buffer[v] = (uint08)(v * 7 + 1);
+
+  memset(&Buffer[300], 0, Buffer.size() - 300);
+
+  CHECK(TrimZeros(Buffer.data(), (uint32)Buffer.size()) == TrimZerosSlowly(Buffer.data(), (uint32)Buffer.size()));
+  CHECK(TrimZeros(Buffer.data(), (uint32)Buffer.size()) == 300);
+  CHECK(TrimZeros(Buffer.data(), 200) == 200);
+  CHECK(TrimZeros(Buffer.data(), 1) == 1);
+  CHECK(TrimZeros(&Buffer[300], 100) == 0);
+}